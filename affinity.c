@@ -0,0 +1,147 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/resource.h>
+
+#include "affinity.h"
+#include "log.h"
+
+// Parse a core list such as "2,3" or "4-7,10" into opts
+int parse_cpu_list(const char *list, struct sched_opts *opts) {
+    const char *p = list;
+
+    CPU_ZERO(&opts->cpus);
+    opts->ncpus = 0;
+    while (*p) {
+        char *end;
+        long lo = strtol(p, &end, 10);
+        long hi = lo;
+        if (end == p || lo < 0) return -1;
+        if (*end == '-') {
+            p = end + 1;
+            hi = strtol(p, &end, 10);
+            if (end == p || hi < lo) return -1;
+        }
+        if (hi >= CPU_SETSIZE) return -1;
+        for (long cpu = lo; cpu <= hi; cpu++) {
+            if (!CPU_ISSET(cpu, &opts->cpus)) {
+                CPU_SET(cpu, &opts->cpus);
+                opts->cpu_list[opts->ncpus++] = cpu;
+            }
+        }
+        if (*end == ',') end++;
+        else if (*end != '\0') return -1;
+        p = end;
+    }
+    return opts->ncpus > 0 ? 0 : -1;
+}
+
+// Parse a whole decimal number within [min, max]
+static int parse_level(const char *arg, int min, int max, int *value) {
+    char *end;
+    long v = strtol(arg, &end, 10);
+    if (*arg == '\0' || *end != '\0' || v < min || v > max) return -1;
+    *value = v;
+    return 0;
+}
+
+// Handle the scheduling options shared by cook, waiter and customer:
+//   -c cpus   run on these cores
+//   -f prio   use SCHED_FIFO at this priority
+//   -n nice   run at this nice level
+// Returns 0 if the option was consumed, -1 if it is invalid.
+int parse_sched_option(int opt, const char *arg, struct sched_opts *opts) {
+    switch (opt) {
+        case 'c':
+            if (parse_cpu_list(arg, opts) == -1) {
+                fprintf(stderr, "Invalid CPU list: %s\n", arg);
+                return -1;
+            }
+            return 0;
+        case 'f':
+            if (parse_level(arg, sched_get_priority_min(SCHED_FIFO),
+                            sched_get_priority_max(SCHED_FIFO), &opts->fifo_prio) == -1) {
+                fprintf(stderr, "Invalid SCHED_FIFO priority: %s\n", arg);
+                return -1;
+            }
+            return 0;
+        case 'n':
+            if (parse_level(arg, -20, 19, &opts->nice_level) == -1) {
+                fprintf(stderr, "Invalid nice level: %s\n", arg);
+                return -1;
+            }
+            opts->set_nice = 1;
+            return 0;
+    }
+    return -1;
+}
+
+// Apply opts to the calling process. Actor number index is pinned to its
+// own core from the list (round robin when there are more actors than
+// cores); index -1 allows the whole set. Failures only warn, so a run
+// without CAP_SYS_NICE still goes ahead with normal scheduling.
+void apply_sched_opts(const struct sched_opts *opts, int index) {
+    if (opts->ncpus > 0) {
+        cpu_set_t set;
+        if (index >= 0) {
+            CPU_ZERO(&set);
+            CPU_SET(opts->cpu_list[index % opts->ncpus], &set);
+        } else {
+            set = opts->cpus;
+        }
+        if (sched_setaffinity(0, sizeof(set), &set) == -1) {
+            perror("sched_setaffinity");
+        }
+    }
+
+    if (opts->fifo_prio > 0) {
+        struct sched_param param = { .sched_priority = opts->fifo_prio };
+        if (sched_setscheduler(0, SCHED_FIFO, &param) == -1) {
+            perror("sched_setscheduler");
+        }
+    } else if (opts->set_nice) {
+        if (setpriority(PRIO_PROCESS, 0, opts->nice_level) == -1) {
+            perror("setpriority");
+        }
+    }
+}
+
+// Record one wake-to-run sample. wait_start is when the caller started
+// blocking and slot is the wake stamp its signaller wrote; a stamp older
+// than wait_start means the wakeup was already pending and we never slept.
+void latency_record(struct latency_hist *hist, long long wait_start, long long *slot) {
+    long long stamp = __atomic_load_n(slot, __ATOMIC_RELAXED);
+    if (stamp < wait_start) return;
+
+    long long ns = now_ns() - stamp;
+    int bucket = 0;
+    while (bucket < LATENCY_BUCKETS - 1 && (1LL << bucket) < ns) bucket++;
+
+    hist->buckets[bucket]++;
+    hist->count++;
+    if (ns > hist->max_ns) hist->max_ns = ns;
+}
+
+static double latency_percentile(const struct latency_hist *hist, double pct) {
+    unsigned long target = (unsigned long)(hist->count * pct);
+    unsigned long seen = 0;
+    for (int i = 0; i < LATENCY_BUCKETS; i++) {
+        seen += hist->buckets[i];
+        if (seen > target) {
+            long long bound = (1LL << i) < hist->max_ns ? (1LL << i) : hist->max_ns;
+            return bound / 1000.0;
+        }
+    }
+    return hist->max_ns / 1000.0;
+}
+
+void latency_report(const char *name, const struct latency_hist *hist) {
+    if (hist->count == 0) {
+        log_printf("%s: wake-to-run latency: no blocking wakeups\n", name);
+        return;
+    }
+    log_printf("%s: wake-to-run latency (us): n=%lu p50<=%.1f p90<=%.1f p99<=%.1f max=%.1f\n",
+           name, hist->count, latency_percentile(hist, 0.50), latency_percentile(hist, 0.90),
+           latency_percentile(hist, 0.99), hist->max_ns / 1000.0);
+}
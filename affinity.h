@@ -0,0 +1,43 @@
+#ifndef AFFINITY_H
+#define AFFINITY_H
+
+#include <sched.h>
+#include <time.h>
+
+// Scheduling options for one group of actors (cooks, waiters or customers)
+struct sched_opts {
+    cpu_set_t cpus;      // allowed cores, empty = leave to the kernel
+    int ncpus;
+    int cpu_list[CPU_SETSIZE];
+    int fifo_prio;       // SCHED_FIFO priority, 0 = normal scheduling
+    int nice_level;
+    int set_nice;
+};
+
+// Log2 histogram of wake-to-run latencies in nanoseconds
+#define LATENCY_BUCKETS 40
+struct latency_hist {
+    unsigned long buckets[LATENCY_BUCKETS];
+    unsigned long count;
+    long long max_ns;
+};
+
+static inline long long now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+// Stamp a wake slot in shared memory just before signalling its sleeper
+static inline void stamp_wake(long long *slot) {
+    __atomic_store_n(slot, now_ns(), __ATOMIC_RELAXED);
+}
+
+int parse_cpu_list(const char *list, struct sched_opts *opts);
+int parse_sched_option(int opt, const char *arg, struct sched_opts *opts);
+void apply_sched_opts(const struct sched_opts *opts, int index);
+
+void latency_record(struct latency_hist *hist, long long wait_start, long long *slot);
+void latency_report(const char *name, const struct latency_hist *hist);
+
+#endif
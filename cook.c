@@ -1,329 +1,367 @@
-#include <stdio.h>
-#include <stdlib.h>
-#include <unistd.h>
-#include <sys/types.h>
-#include <sys/ipc.h>
-#include <sys/shm.h>
-#include <sys/sem.h>
-#include <sys/wait.h>
-#include <signal.h>
-#include <time.h>
-
-// Constants
-#define SHM_SIZE 2000
-#define SCALE_FACTOR 100000  // 100ms = 100,000 microseconds
-#define TIME_OFFSET 0
-#define EMPTY_TABLES_OFFSET 1
-#define NEXT_WAITER_OFFSET 2
-#define PENDING_ORDERS_OFFSET 3
-#define END_SESSION_OFFSET 4
-#define WAITER_U_OFFSET 100
-#define WAITER_V_OFFSET 300
-#define WAITER_W_OFFSET 500
-#define WAITER_X_OFFSET 700
-#define WAITER_Y_OFFSET 900
-#define COOK_QUEUE_OFFSET 1100
-
-// Semaphore indexes
-#define MUTEX 0
-#define COOK_SEM 1
-#define WAITER_U_SEM 2
-#define WAITER_V_SEM 3
-#define WAITER_W_SEM 4
-#define WAITER_X_SEM 5
-#define WAITER_Y_SEM 6
-#define CUSTOMER_BASE_SEM 7
-
-// Waiter queue offsets (relative to waiter section)
-#define FRONT_OFFSET 0
-#define BACK_OFFSET 1
-#define FOOD_READY_OFFSET 2
-#define PENDING_ORDERS_WAITER_OFFSET 3
-#define QUEUE_START_OFFSET 10
-
-// Cook queue offsets
-#define COOK_FRONT_OFFSET 0
-#define COOK_BACK_OFFSET 1
-#define COOK_QUEUE_START_OFFSET 10
-
-// Semaphore operations
-union semun {
-    int val;
-    struct semid_ds *buf;
-    unsigned short *array;
-};
-
-void sem_wait(int semid, int semnum) {
-    struct sembuf sb = {semnum, -1, 0};
-    if (semop(semid, &sb, 1) == -1) {
-        perror("semop wait");
-        exit(1);
-    }
-}
-
-void sem_signal(int semid, int semnum) {
-    struct sembuf sb = {semnum, 1, 0};
-    if (semop(semid, &sb, 1) == -1) {
-        perror("semop signal");
-        exit(1);
-    }
-}
-
-// Global variables
-int shmid, semid;
-int *shm;
-
-// Function to update time
-void update_time(int minutes) {
-    int curr_time = shm[TIME_OFFSET];
-    usleep(minutes * SCALE_FACTOR);
-    
-    sem_wait(semid, MUTEX);
-    if (shm[TIME_OFFSET] < curr_time + minutes) {
-        shm[TIME_OFFSET] = curr_time + minutes;
-    } else {
-      //  printf("Warning: Setting time failed, current time: %d, attempted new time: %d\n",
-         //   shm[TIME_OFFSET], curr_time + minutes);
-     
-    }
-    sem_signal(semid, MUTEX);
-}
-char* get_time_string(int minutes) {
-    static char time_str[20];
-    int hour = (minutes / 60) + 11; // Start at 11:00
-    int min = minutes % 60;
-    char am_pm = (hour < 12) ? 'a' : 'p';
-    if (hour > 12) hour -= 12;
-    sprintf(time_str, "[%d:%02d %cm]", hour, min, am_pm);
-    return time_str;
-}
-
-// Cook implementation
-void cmain(int cook_id) {
-    char cook_name = (cook_id == 0) ? 'C' : 'D';
-
-    // Initial ready message
-    if (cook_id == 0) {
-        printf("[11:00 am] Cook %c is ready\n", cook_name);
-    } else {
-        printf("[11:00 am] \tCook %c is ready\n", cook_name);
-    }
-
-    while (1) {
-        // Wait for cooking request
-        sem_wait(semid, COOK_SEM);
-        sem_wait(semid, MUTEX);
-
-        // Check if it's end of session time
-        if (shm[TIME_OFFSET] >= 240 && shm[PENDING_ORDERS_OFFSET] == 0) {
-            int current_time = shm[TIME_OFFSET];
-            // Determine AM/PM and correct hour
-            int hour = (11 + current_time / 60);
-            int min = current_time % 60;
-            char *ampm = (hour < 12) ? "am" : "pm";
-            if (hour > 12) hour -= 12; // Convert from 24-hour to 12-hour format
-
-            // Print leaving message
-            if (cook_id == 0) {
-                printf("[%d:%02d %s] Cook %c: Leaving\n", hour, min, ampm, cook_name);
-            } else {
-                printf("[%d:%02d %s] \tCook %c: Leaving\n", hour, min, ampm, cook_name);
-            }
-
-            shm[END_SESSION_OFFSET]++;
-            for (int i = 0; i < 5; i++) {
-                sem_signal(semid, WAITER_U_SEM + i);
-            }
-
-            sem_signal(semid, MUTEX);
-            shmdt(shm);
-            exit(0);
-        }
-
-        // Get a cooking request from the queue
-        int cook_front = shm[COOK_QUEUE_OFFSET + COOK_FRONT_OFFSET];
-        int waiter_id = shm[COOK_QUEUE_OFFSET + COOK_QUEUE_START_OFFSET + cook_front * 3];
-        int customer_id = shm[COOK_QUEUE_OFFSET + COOK_QUEUE_START_OFFSET + cook_front * 3 + 1];
-        int customer_cnt = shm[COOK_QUEUE_OFFSET + COOK_QUEUE_START_OFFSET + cook_front * 3 + 2];
-
-        // Update front of queue
-        shm[COOK_QUEUE_OFFSET + COOK_FRONT_OFFSET] = (cook_front + 1) % 200;
-        shm[PENDING_ORDERS_OFFSET]--;
-
-        char waiter_name = 'U' + waiter_id; // Convert ID to letter
-
-        int current_time = shm[TIME_OFFSET];
-        // Print "Preparing order" message
-        int hour = (11 + current_time / 60);
-        int min = current_time % 60;
-        char *ampm = (hour < 12) ? "am" : "pm";
-        if (hour > 12) hour -= 12; // Convert from 24-hour to 12-hour format
-
-        if (cook_id == 0) {
-            printf("[%d:%02d %s] Cook %c: Preparing order (Waiter %c, Customer %d, Count %d)\n",
-                   hour, min, ampm, cook_name, waiter_name, customer_id, customer_cnt);
-        } else {
-            printf("[%d:%02d %s] \tCook %c: Preparing order (Waiter %c, Customer %d, Count %d)\n",
-                   hour, min, ampm, cook_name, waiter_name, customer_id, customer_cnt);
-        }
-
-        sem_signal(semid, MUTEX);
-
-        // Cook the food (5 minutes per person)
-        update_time(customer_cnt * 5);
-
-        // Food is ready, notify waiter
-        sem_wait(semid, MUTEX);
-
-        // Find waiter's section in shared memory
-        int waiter_offset;
-        switch (waiter_id) {
-            case 0: waiter_offset = WAITER_U_OFFSET; break;
-            case 1: waiter_offset = WAITER_V_OFFSET; break;
-            case 2: waiter_offset = WAITER_W_OFFSET; break;
-            case 3: waiter_offset = WAITER_X_OFFSET; break;
-            case 4: waiter_offset = WAITER_Y_OFFSET; break;
-            default: waiter_offset = WAITER_U_OFFSET;
-        }
-
-        // Set food ready indicator for the waiter
-        shm[waiter_offset + FOOD_READY_OFFSET] = customer_id;
-
-        current_time = shm[TIME_OFFSET];
-        // Print "Prepared order" message
-        hour = (11 + current_time / 60);
-        min = current_time % 60;
-        ampm = (hour < 12) ? "am" : "pm";
-        if (hour > 12) hour -= 12; // Convert from 24-hour to 12-hour format
-
-        if (cook_id == 0) {
-            printf("[%d:%02d %s] Cook %c: Prepared order (Waiter %c, Customer %d, Count %d)\n",
-                   hour, min, ampm, cook_name, waiter_name, customer_id, customer_cnt);
-        } else {
-            printf("[%d:%02d %s] \tCook %c: Prepared order (Waiter %c, Customer %d, Count %d)\n",
-                   hour, min, ampm, cook_name, waiter_name, customer_id, customer_cnt);
-        }
-
-        sem_signal(semid, MUTEX);
-
-        // Wake up the waiter
-        sem_signal(semid, WAITER_U_SEM + waiter_id);
-    }
-}
-
-
-int main() {
-    key_t key_shm, key_sem;
-    
-    // Generate keys for IPC
-    key_shm = ftok("cook.c", 'R');
-    key_sem = ftok("cook.c", 'S');
-    
-    if (key_shm == -1 || key_sem == -1) {
-        perror("ftok");
-        exit(1);
-    }
-    
-    // Create shared memory
-    shmid = shmget(key_shm, SHM_SIZE * sizeof(int), IPC_CREAT | 0666);
-    if (shmid == -1) {
-        perror("shmget");
-        exit(1);
-    }
-    
-    // Attach to shared memory
-    shm = (int *)shmat(shmid, NULL, 0);
-    if (shm == (int *)-1) {
-        perror("shmat");
-        exit(1);
-    }
-    
-    // Initialize shared memory
-    shm[TIME_OFFSET] = 0;              // Starting time (11:00am)
-    shm[EMPTY_TABLES_OFFSET] = 10;     // 10 empty tables
-    shm[NEXT_WAITER_OFFSET] = 0;       // First waiter is U (index 0)
-    shm[PENDING_ORDERS_OFFSET] = 0;    // No pending orders initially
-    shm[END_SESSION_OFFSET] = 0;       // End of session flag
-    
-    // Initialize queues
-    for (int i = 0; i < 5; i++) {
-        int offset = WAITER_U_OFFSET + i * 200;
-        shm[offset + FRONT_OFFSET] = 0;
-        shm[offset + BACK_OFFSET] = 0;
-        shm[offset + FOOD_READY_OFFSET] = 0;
-        shm[offset + PENDING_ORDERS_WAITER_OFFSET] = 0;
-    }
-    
-    // Initialize cook queue
-    shm[COOK_QUEUE_OFFSET + COOK_FRONT_OFFSET] = 0;
-    shm[COOK_QUEUE_OFFSET + COOK_BACK_OFFSET] = 0;
-    
-    // Create semaphores
-    // Need: mutex, cook, 5 waiters, and up to 200 customers
-    semid = semget(key_sem, CUSTOMER_BASE_SEM + 200, IPC_CREAT | 0666);
-    if (semid == -1) {
-        perror("semget");
-        exit(1);
-    }
-    
-    // Initialize semaphores
-    union semun arg;
-    
-    // Mutex = 1 (available)
-    arg.val = 1;
-    if (semctl(semid, MUTEX, SETVAL, arg) == -1) {
-        perror("semctl: MUTEX");
-        exit(1);
-    }
-    
-    // Cook = 0 (no cooking requests initially)
-    arg.val = 0;
-    if (semctl(semid, COOK_SEM, SETVAL, arg) == -1) {
-        perror("semctl: COOK_SEM");
-        exit(1);
-    }
-    
-    // Waiters = 0 (no requests initially)
-    for (int i = WAITER_U_SEM; i <= WAITER_Y_SEM; i++) {
-        if (semctl(semid, i, SETVAL, arg) == -1) {
-            perror("semctl: WAITER_SEM");
-            exit(1);
-        }
-    }
-    
-    // Customers = 0 (no signals initially)
-    for (int i = 0; i < 200; i++) {
-        if (semctl(semid, CUSTOMER_BASE_SEM + i, SETVAL, arg) == -1) {
-            perror("semctl: CUSTOMER_SEM");
-            exit(1);
-        }
-    }
-    
-    printf("Cook: IPC resources initialized\n");
-    printf("Cook: Starting cooks C and D\n");
-    
-    // Create two cook processes
-    pid_t pid[2];
-    for (int i = 0; i < 2; i++) {
-        pid[i] = fork();
-        if (pid[i] < 0) {
-            perror("fork");
-            exit(1);
-        } else if (pid[i] == 0) {
-            cmain(i);  // This never returns
-            exit(0);
-        }
-    }
-    
-    // Wait for cooks to terminate
-    for (int i = 0; i < 2; i++) {
-        waitpid(pid[i], NULL, 0);
-    }
-    
-    printf("Cook: Both cooks have terminated. Keeping IPC resources for customers to clean up.\n");
-    
-    // Note: We don't clean up IPC resources here. 
-    // The customer's parent process is responsible for that after all processes finish.
-    
-    return 0;
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/ipc.h>
+#include <sys/shm.h>
+#include <sys/sem.h>
+#include <sys/wait.h>
+#include <signal.h>
+#include <time.h>
+#include <errno.h>
+#include <string.h>
+
+#include "restaurant.h"
+#include "affinity.h"
+#include "spinwait.h"
+#include "ipc.h"
+#include "snapshot.h"
+#include "detsched.h"
+#include "menu.h"
+
+// Global variables
+int shmid, semid;
+struct shm_segment *shm;
+struct latency_hist wake_latency;
+int max_spin = SPIN_DEFAULT_MAX;
+int log_mode = LOG_LINE;
+
+// Repost the wakeups that waiters held back while the kitchen was full,
+// so each takes its deferred orders. Called under MUTEX.
+static void release_waiters(void) {
+    for (int i = 0; i < NUM_WAITERS; i++) {
+        for (; DEFERRED(&shm->waiters[i]) > 0; shm->waiters[i].released++) {
+            wake_waiter(shm, semid, i);
+        }
+    }
+}
+
+// Cook implementation
+void cmain(int cook_id) {
+    char cook_name = 'C' + cook_id;
+    int station = shm->menu.cook_station[cook_id];
+    const char *station_name = shm->menu.stations[station];
+    int one_station = shm->menu.num_stations == 1;
+    struct cook_queue *queue = &shm->stations[station];
+    struct spin_wait work;
+    spin_wait_init(&work, semid, STATION_BASE_SEM + station, &queue->seq,
+                   &shm->staff[COOK_STATS(cook_id)].spin, max_spin);
+
+    // Initial ready message
+    prof_start();
+    perturb_init(&shm->config, DET_COOK(cook_id));
+    log_event(shm->time, indent_prefix(cook_id), "Cook %c is ready\n", cook_name);
+
+    while (1) {
+        // Wait for cooking request
+        long long wait_start = now_ns();
+        spin_wait(&work);
+        latency_record(&wake_latency, wait_start, &queue->wake_ns);
+        sem_wait(semid, MUTEX);
+
+        // Check if it's end of session time
+        if (shm->time >= shm->config.closing_time && QUEUED(queue) == 0) {
+            // Print leaving message
+            log_event(shm->time, indent_prefix(cook_id), "Cook %c: Leaving\n", cook_name);
+
+            shm->end_session++;
+            for (int i = 0; i < NUM_WAITERS; i++) {
+                wake_waiter(shm, semid, i);
+            }
+
+            sem_signal(semid, MUTEX);
+
+            char name[16];
+            unsigned long events, writes;
+            sprintf(name, "Cook %c", cook_name);
+            log_flush();
+            log_stats(&events, &writes);
+            prof_finish();
+            if (det == NULL) latency_report(name, &wake_latency);
+            if (det == NULL) prof_report(name, &prof);
+            spin_report(name, work.stats);
+            log_report(name, events, writes);
+            if (det != NULL) det_exit();
+            shmdt(shm);
+            exit(0);
+        }
+
+        // Get this station's share of an order from the queue
+        int cook_front = queue->front % COOK_QUEUE_SIZE;
+        struct cook_order *ticket = slab_ptr(&shm->heap, queue->orders[cook_front]);
+        int waiter_id = ticket->waiter_id;
+        int customer_id = ticket->customer_id;
+        int customer_cnt = ticket->customer_cnt;
+        queue->queue_minutes += shm->time - ticket->queued_at;
+        slab_free(&shm->heap, queue->orders[cook_front]);
+
+        // Update front of queue
+        queue->front++;
+        if (QUEUED(queue) <= LOW_WATER(&shm->config)) release_waiters();
+
+        char waiter_name = 'U' + waiter_id; // Convert ID to letter
+        struct order *order = &shm->customers[customer_id].order;
+        int minutes = station_minutes(shm, order, station);
+
+        // Print "Preparing order" message; with several stations, say
+        // which dishes this station makes
+        if (one_station) {
+            log_event(shm->time, indent_prefix(cook_id),
+                      "Cook %c: Preparing order (Waiter %c, Customer %d, Count %d)\n",
+                      cook_name, waiter_name, customer_id, customer_cnt);
+        } else {
+            char items[LOG_LINE_MAX / 2];
+            format_items(shm, order, station, items, sizeof(items));
+            log_event(shm->time, indent_prefix(cook_id),
+                      "Cook %c: Preparing %s at %s (Waiter %c, Customer %d, Count %d)\n",
+                      cook_name, items, station_name, waiter_name, customer_id, customer_cnt);
+        }
+
+        sem_signal(semid, MUTEX);
+
+        // Cook the food (5 minutes per person with the default menu)
+        update_time(shm, semid, minutes);
+
+        sem_wait(semid, MUTEX);
+        queue->batches++;
+        queue->busy_minutes += minutes;
+        kitchen_record(queue, minutes);
+
+        // Other stations may still be working on the order
+        order->stations_left &= ~(1u << station);
+        if (order->stations_left != 0) {
+            log_event(shm->time, indent_prefix(cook_id),
+                      "Cook %c: Prepared %s part of order (Waiter %c, Customer %d, Count %d)\n",
+                      cook_name, station_name, waiter_name, customer_id, customer_cnt);
+            sem_signal(semid, MUTEX);
+            continue;
+        }
+
+        // Food is ready: queue it for the waiter
+        struct waiter_queue *wq = &shm->waiters[waiter_id];
+        if (READY(wq) == WAITER_QUEUE_SIZE) {
+            fprintf(stderr, "Cook %c: food queue of Waiter %c overflowed\n", cook_name, waiter_name);
+            exit(1);
+        }
+        wq->ready_ids[wq->ready_back % WAITER_QUEUE_SIZE] = customer_id;
+        wq->ready_back++;
+        shm->customers[customer_id].state = CUST_COOKED;
+
+        // Print "Prepared order" message
+        log_event(shm->time, indent_prefix(cook_id),
+                  "Cook %c: Prepared order (Waiter %c, Customer %d, Count %d)\n",
+                  cook_name, waiter_name, customer_id, customer_cnt);
+
+        sem_signal(semid, MUTEX);
+
+        // Wake up the waiter
+        wake_waiter(shm, semid, waiter_id);
+    }
+}
+
+volatile sig_atomic_t snapshot_requested = 0;
+
+static void request_snapshot(int sig) {
+    snapshot_requested = 1;
+}
+
+// Snapshot the live session and report how long the actors were paused
+static void take_snapshot(const char *path, int pause_target_us) {
+    long long pause_ns;
+    if (snapshot_save(shm, semid, path, &pause_ns) == -1) {
+        log_printf("Cook: Snapshot to %s failed\n", path);
+        return;
+    }
+    log_printf("Cook: Snapshot of %s written to %s (pause %.1f us)\n",
+           get_time_string(shm->time), path, pause_ns / 1000.0);
+    if (pause_ns > pause_target_us * 1000LL) {
+        log_printf("Cook: Warning: snapshot pause exceeded target of %d us\n", pause_target_us);
+    }
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr, "Usage: %s [-c cpus] [-f fifo_prio] [-n nice] [-s max_spin] [-b]\n"
+                    "       [-S snapshot_file] [-T pause_target_us] [-R snapshot_file]\n"
+                    "       [-u usec_per_minute] [-k cooks] [-t tables] [-p cook_minutes]\n"
+                    "       [-o order_minutes] [-e eat_minutes] [-z closing_time]\n"
+                    "       [-H high_water] [-W max_wait] [-y perturb_permille] [-Y perturb_seed]\n"
+                    "       [-d seed] [-m menu_file] [-A station,station,...]\n", prog);
+    exit(1);
+}
+
+int main(int argc, char *argv[]) {
+    key_t key_shm, key_sem;
+    struct sched_opts sched = {0};
+    int opt;
+    const char *snapshot_path = SNAPSHOT_DEFAULT_PATH;
+    const char *restore_path = NULL;
+    int pause_target_us = SNAPSHOT_PAUSE_TARGET_US;
+    struct session_config config;
+    config_defaults(&config);
+    int deterministic = 0;
+    unsigned seed = 0;
+    const char *menu_path = NULL;
+    const char *stations = NULL;
+
+    while ((opt = getopt(argc, argv, "c:f:n:s:bS:T:R:u:k:t:p:o:e:z:H:W:y:Y:d:m:A:")) != -1) {
+        if (opt == 's') {
+            if (parse_int_option(opt, optarg, 0, SPIN_LIMIT, &max_spin) == -1) usage(argv[0]);
+        }
+        else if (opt == 'b') log_mode = LOG_BUFFERED;
+        else if (opt == 'S') snapshot_path = optarg;
+        else if (opt == 'T') {
+            if (parse_int_option(opt, optarg, 1, 10000000, &pause_target_us) == -1) usage(argv[0]);
+        }
+        else if (opt == 'R') restore_path = optarg;
+        else if (opt == 'm') menu_path = optarg;
+        else if (opt == 'A') stations = optarg;
+        else if (opt == 'd') {
+            deterministic = 1;
+            seed = strtoul(optarg, NULL, 0);
+        }
+        else if (strchr("uktpoezHWyY", opt) != NULL) {
+            if (parse_config_option(opt, optarg, &config) == -1) usage(argv[0]);
+        }
+        else if (parse_sched_option(opt, optarg, &sched) == -1) usage(argv[0]);
+    }
+    if (deterministic && restore_path != NULL) {
+        fprintf(stderr, "%s: -d and -R cannot be combined\n", argv[0]);
+        usage(argv[0]);
+    }
+    log_init(log_mode);
+    
+    // The default menu is one dish taking -p minutes per person
+    struct menu menu;
+    if (menu_path == NULL) menu_default(&menu, config.cook_minutes);
+    else if (menu_load(&menu, menu_path) == -1) exit(1);
+    if (menu_assign(&menu, config.num_cooks, stations) == -1) exit(1);
+    
+    // Generate keys for IPC
+    ipc_keys(&key_shm, &key_sem);
+    
+    // Create shared memory and semaphores (need: mutex, 5 waiters, the
+    // cook stations and up to 200 customers), replacing any left by a crashed session
+    unsigned generation = ipc_create(key_shm, key_sem, &shmid, &semid, &shm);
+    
+    // Initialize shared memory
+    shm->config = config;
+    shm->menu = menu;
+    slab_init(&shm->heap);
+    kitchen_init(shm);
+    shm->time = 0;              // Starting time (11:00am)
+    shm->empty_tables = config.num_tables;  // 10 empty tables by default
+    shm->next_waiter = 0;       // First waiter is U (index 0)
+    shm->end_session = 0;       // End of session flag
+    
+    // Initialize semaphores
+    union semun arg;
+    
+    // Mutex = 1 (available)
+    arg.val = 1;
+    if (semctl(semid, MUTEX, SETVAL, arg) == -1) {
+        perror("semctl: MUTEX");
+        exit(1);
+    }
+    
+    // Stations = 0 (no cooking requests initially)
+    arg.val = 0;
+    for (int i = 0; i < MAX_STATIONS; i++) {
+        if (semctl(semid, STATION_BASE_SEM + i, SETVAL, arg) == -1) {
+            perror("semctl: STATION_SEM");
+            exit(1);
+        }
+    }
+    
+    // Waiters = 0 (no requests initially)
+    for (int i = WAITER_U_SEM; i <= WAITER_Y_SEM; i++) {
+        if (semctl(semid, i, SETVAL, arg) == -1) {
+            perror("semctl: WAITER_SEM");
+            exit(1);
+        }
+    }
+    
+    // Customers = 0 (no signals initially)
+    for (int i = 0; i < MAX_CUSTOMERS; i++) {
+        if (semctl(semid, CUSTOMER_BASE_SEM + i, SETVAL, arg) == -1) {
+            perror("semctl: CUSTOMER_SEM");
+            exit(1);
+        }
+    }
+    if (semctl(semid, ENGINE_SEM, SETVAL, arg) == -1) {
+        perror("semctl: ENGINE_SEM");
+        exit(1);
+    }
+    
+    // Resume a session from a snapshot instead of starting at 11:00am; it
+    // keeps the parameters it was started with
+    if (restore_path != NULL) {
+        if (snapshot_restore(shm, semid, restore_path) == -1) {
+            shmctl(shmid, IPC_RMID, NULL);
+            semctl(semid, 0, IPC_RMID);
+            exit(1);
+        }
+        log_printf("Cook: Restored session at %s from %s\n", get_time_string(shm->time), restore_path);
+    }
+    
+    // A deterministic session schedules every actor itself; see detsched.c
+    if (deterministic) {
+        det_init(shm, seed);
+        log_printf("Cook: Deterministic mode, seed %u\n", seed);
+    }
+    det_attach(shm, semid);
+    
+    // kill -USR1 takes a snapshot of the running session
+    struct sigaction sa = {0};
+    sa.sa_handler = request_snapshot;
+    sigaction(SIGUSR1, &sa, NULL);
+    
+    ipc_publish(shm);
+    log_printf("Cook: IPC resources initialized (generation %u)\n", generation);
+    int num_cooks = shm->config.num_cooks;
+    log_printf("Cook: Starting %d cooks (C to %c)\n", num_cooks, 'C' + num_cooks - 1);
+    for (int i = 0; i < num_cooks && shm->menu.num_stations > 1; i++) {
+        log_printf("Cook: Cook %c works at %s\n", 'C' + i,
+                   shm->menu.stations[shm->menu.cook_station[i]]);
+    }
+    log_flush();
+    
+    // Create the cook processes
+    pid_t pid[MAX_COOKS];
+    for (int i = 0; i < num_cooks; i++) {
+        if (det != NULL) det_register(DET_COOK(i));
+        pid[i] = fork();
+        if (pid[i] < 0) {
+            perror("fork");
+            exit(1);
+        } else if (pid[i] == 0) {
+            signal(SIGUSR1, SIG_IGN);
+            log_init(log_mode);
+            apply_sched_opts(&sched, i);
+            if (det != NULL) det_begin(DET_COOK(i));
+            cmain(i);  // This never returns
+            exit(0);
+        }
+        shm->header.staff_pids[COOK_STATS(i)] = pid[i];
+    }
+    
+    // Wait for cooks to terminate, taking snapshots as requested
+    int running = num_cooks;
+    while (running > 0) {
+        if (waitpid(-1, NULL, 0) > 0) {
+            running--;
+        } else if (errno != EINTR) {
+            break;
+        } else if (snapshot_requested) {
+            snapshot_requested = 0;
+            take_snapshot(snapshot_path, pause_target_us);
+        }
+    }
+    
+    station_report(shm);
+    log_printf("Cook: All cooks have terminated. Keeping IPC resources for customers to clean up.\n");
+    
+    // Note: We don't clean up IPC resources here. 
+    // The customer's parent process is responsible for that after all processes finish.
+    
+    return 0;
 }
\ No newline at end of file
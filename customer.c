@@ -1,361 +1,596 @@
-#include <stdio.h>
-#include <stdlib.h>
-#include <unistd.h>
-#include <sys/types.h>
-#include <sys/ipc.h>
-#include <sys/shm.h>
-#include <sys/sem.h>
-#include <sys/wait.h>
-#include <signal.h>
-#include <time.h>
-#include <string.h>
-
-// Constants
-#define SHM_SIZE 2000
-#define SCALE_FACTOR 100000  // 100ms = 100,000 microseconds
-#define TIME_OFFSET 0
-#define EMPTY_TABLES_OFFSET 1
-#define NEXT_WAITER_OFFSET 2
-#define PENDING_ORDERS_OFFSET 3
-#define END_SESSION_OFFSET 4
-#define WAITER_U_OFFSET 100
-#define WAITER_V_OFFSET 300
-#define WAITER_W_OFFSET 500
-#define WAITER_X_OFFSET 700
-#define WAITER_Y_OFFSET 900
-#define COOK_QUEUE_OFFSET 1100
-
-// Semaphore indexes
-#define MUTEX 0
-#define COOK_SEM 1
-#define WAITER_U_SEM 2
-#define WAITER_V_SEM 3
-#define WAITER_W_SEM 4
-#define WAITER_X_SEM 5
-#define WAITER_Y_SEM 6
-#define CUSTOMER_BASE_SEM 7
-
-// Waiter queue offsets (relative to waiter section)
-#define FRONT_OFFSET 0
-#define BACK_OFFSET 1
-#define FOOD_READY_OFFSET 2
-#define PENDING_ORDERS_WAITER_OFFSET 3
-#define QUEUE_START_OFFSET 10
-
-// Cook queue offsets
-#define COOK_FRONT_OFFSET 0
-#define COOK_BACK_OFFSET 1
-#define COOK_QUEUE_START_OFFSET 10
-
-// Global variables
-int shmid, semid;
-
-// Semaphore operations
-union semun {
-    int val;
-    struct semid_ds *buf;
-    unsigned short *array;
-};
-
-void sem_wait(int semid, int semnum) {
-    struct sembuf sb = {semnum, -1, 0};
-    if (semop(semid, &sb, 1) == -1) {
-        perror("semop wait");
-        exit(1);
-    }
-}
-
-void sem_signal(int semid, int semnum) {
-    struct sembuf sb = {semnum, 1, 0};
-    if (semop(semid, &sb, 1) == -1) {
-        perror("semop signal");
-        exit(1);
-    }
-}
-
-// Function to update time
-void update_time(int minutes, int *shm) {
-    int curr_time = shm[TIME_OFFSET];
-    usleep(minutes * SCALE_FACTOR);
-    
-    sem_wait(semid, MUTEX);
-    if (shm[TIME_OFFSET] < curr_time + minutes) {
-        shm[TIME_OFFSET] = curr_time + minutes;
-    }
-    sem_signal(semid, MUTEX);
-}
-
-// Function to format time for output
-void format_time(int minutes, int *hours, int *mins, char *am_pm) {
-    *hours = 11 + minutes / 60;
-    *mins = minutes % 60;
-    
-    strcpy(am_pm, "am");
-    if (*hours >= 12) {
-        strcpy(am_pm, "pm");
-        if (*hours > 12) {
-            *hours -= 12;
-        }
-    }
-}
-
-// Customer implementation
-void cmain(int customer_id, int arrival_time, int customer_cnt) {
-    // Attach to shared memory
-    int *shm = (int *)shmat(shmid, NULL, 0);
-    if (shm == (int *)-1) {
-        perror("shmat");
-        exit(1);
-    }
-    
-    // Record arrival time for calculating waiting time later
-    int arrival_time_actual;
-    
-    // Set time to arrival time
-    sem_wait(semid, MUTEX);
-    shm[TIME_OFFSET] = arrival_time;
-    arrival_time_actual = arrival_time; 
-    
-    // Print arrival message with timestamp
-    int hours, minutes;
-    char am_pm[3];
-    format_time(arrival_time_actual, &hours, &minutes, am_pm);
-    
-    printf("[%d:%02d %s] Customer %d arrives (count = %d)\n", 
-           hours, minutes, am_pm, customer_id, customer_cnt);
-    
-    // Check if it's after 3:00pm (240 minutes after 11:00am)
-    if (shm[TIME_OFFSET] >= 240) {
-        printf("[%d:%02d %s]\t\t\t\t\t\tCustomer %d leaves (late arrival)\n", 
-               hours, minutes, am_pm, customer_id);
-        sem_signal(semid, MUTEX);
-        shmdt(shm);
-        exit(0);
-    }
-    
-    // Check if a table is available
-    if (shm[EMPTY_TABLES_OFFSET] <= 0) {
-        printf("[%d:%02d %s]\t\t\t\t\t\tCustomer %d leaves (no empty table)\n", 
-               hours, minutes, am_pm, customer_id);
-        sem_signal(semid, MUTEX);
-        shmdt(shm);
-        exit(0);
-    }
-    
-    // Use an empty table
-    shm[EMPTY_TABLES_OFFSET]--;
-    sem_signal(semid, MUTEX);
-    
-    // Find the waiter to serve
-    sem_wait(semid, MUTEX);
-    int waiter_num = shm[NEXT_WAITER_OFFSET];
-    shm[NEXT_WAITER_OFFSET] = (waiter_num + 1) % 5;
-    
-    // Determine waiter's section in shared memory
-    int waiter_offset;
-    switch (waiter_num) {
-        case 0: waiter_offset = WAITER_U_OFFSET; break;
-        case 1: waiter_offset = WAITER_V_OFFSET; break;
-        case 2: waiter_offset = WAITER_W_OFFSET; break;
-        case 3: waiter_offset = WAITER_X_OFFSET; break;
-        case 4: waiter_offset = WAITER_Y_OFFSET; break;
-        default: waiter_offset = WAITER_U_OFFSET;
-    }
-    
-    char waiter_name = 'U' + waiter_num;
-    
-    // Add customer to waiter's queue
-    int back = shm[waiter_offset + BACK_OFFSET];
-    shm[waiter_offset + QUEUE_START_OFFSET + back * 2] = customer_id;
-    shm[waiter_offset + QUEUE_START_OFFSET + back * 2 + 1] = customer_cnt;
-    
-    // Update back of queue
-    shm[waiter_offset + BACK_OFFSET] = (back + 1) % 100;
-    shm[waiter_offset + PENDING_ORDERS_WAITER_OFFSET]++;
-    
-    sem_signal(semid, MUTEX);
-    
-    // Signal waiter to take the order
-    sem_signal(semid, WAITER_U_SEM + waiter_num);
-    
-    // Wait for waiter to take order
-    sem_wait(semid, CUSTOMER_BASE_SEM + customer_id);
-    
-    // Print order placed message with timestamp
-    sem_wait(semid, MUTEX);
-    int current_time = shm[TIME_OFFSET];
-    sem_signal(semid, MUTEX);
-    
-    format_time(current_time, &hours, &minutes, am_pm);
-    
-    printf("[%d:%02d %s] \tCustomer %d: Order placed to Waiter %c\n", 
-           hours, minutes, am_pm, customer_id, waiter_name);
-    
-    // Wait for food to be served
-    sem_wait(semid, CUSTOMER_BASE_SEM + customer_id);
-    
-    // Print food received message with timestamp and waiting time
-    sem_wait(semid, MUTEX);
-    current_time = shm[TIME_OFFSET];
-    sem_signal(semid, MUTEX);
-    
-    int waiting_time = current_time - arrival_time_actual;
-    format_time(current_time, &hours, &minutes, am_pm);
-    
-    printf("[%d:%02d %s] \t\tCustomer %d gets food [Waiting time = %d]\n", 
-           hours, minutes, am_pm, customer_id, waiting_time);
-    
-    // Eat food (takes 30 minutes)
-    update_time(30, shm);
-
-    // Print message that customer has finished eating and is leaving
-    sem_wait(semid, MUTEX);
-    current_time = shm[TIME_OFFSET];
-    format_time(current_time, &hours, &minutes, am_pm);
-    
-    printf("[%d:%02d %s] \t\t\tCustomer %d finishes eating and leaves\n", 
-        hours, minutes, am_pm, customer_id);
-    
-    // Free the table
-    shm[EMPTY_TABLES_OFFSET]++;
-    sem_signal(semid, MUTEX);
-    
-    // Detach from shared memory and exit
-    shmdt(shm);
-    exit(0);
-}
-
-int main() {
-    FILE *fp;
-    int customer_id, arrival_time, customer_cnt;
-    int last_arrival_time = 0;
-    
-    key_t key_shm, key_sem;
-    
-    // Generate keys for IPC
-    key_shm = ftok("cook.c", 'R');
-    key_sem = ftok("cook.c", 'S');
-    
-    if (key_shm == -1 || key_sem == -1) {
-        perror("ftok");
-        exit(1);
-    }
-    
-    // Get shared memory
-    shmid = shmget(key_shm, SHM_SIZE * sizeof(int), 0666);
-    if (shmid == -1) {
-        perror("shmget");
-        exit(1);
-    }
-    
-    // Get semaphores
-    semid = semget(key_sem, CUSTOMER_BASE_SEM + 200, 0666);
-    if (semid == -1) {
-        perror("semget");
-        exit(1);
-    }
-    
-    printf("Customer: IPC resources attached\n");
-    
-    // Open customer file
-    fp = fopen("customers.txt", "r");
-    if (fp == NULL) {
-        perror("fopen");
-        exit(1);
-    }
-    
-    printf("Customer: Processing customer arrivals from customers.txt\n");
-    
-    // Array to store child PIDs
-    pid_t *child_pids = NULL;
-    int num_customers = 0;
-    
-    // Read customer information from file
-    while (fscanf(fp, "%d %d %d", &customer_id, &arrival_time, &customer_cnt) == 3) {
-        if (customer_id == -1) {
-            break;  // End of file marker
-        }
-        
-        // Validate customer data
-        if (customer_id <= 0 || arrival_time < 0 || customer_cnt < 1 || customer_cnt > 4) {
-            printf("Invalid customer data: ID=%d, arrival=%d, count=%d. Skipping.\n",
-                   customer_id, arrival_time, customer_cnt);
-            continue;
-        }
-        
-        // Wait for the specified interval between customers
-        if (num_customers > 0) {
-            int wait_time = arrival_time - last_arrival_time;
-            if (wait_time > 0) {
-                usleep(wait_time * SCALE_FACTOR);
-            }
-        }
-        
-        last_arrival_time = arrival_time;
-        
-        // Expand the array of PIDs
-        num_customers++;
-        child_pids = realloc(child_pids, num_customers * sizeof(pid_t));
-        if (child_pids == NULL) {
-            perror("realloc");
-            exit(1);
-        }
-        
-        // Fork a new process for this customer
-        pid_t pid = fork();
-        if (pid < 0) {
-            perror("fork");
-            exit(1);
-        } else if (pid == 0) {
-            // Child process (customer)
-            fclose(fp);  // Close the file in the child
-            free(child_pids);  // Free the array in the child
-            
-            cmain(customer_id, arrival_time, customer_cnt);  // This never returns
-            exit(0);
-        } else {
-            // Parent process
-            child_pids[num_customers - 1] = pid;
-        }
-    }
-    
-    fclose(fp);
-    
-    // Wait for all child processes to terminate
-    for (int i = 0; i < num_customers; i++) {
-        waitpid(child_pids[i], NULL, 0);
-    }
-    
-    free(child_pids);
-    
-   int *shm = (int *)shmat(shmid, NULL, 0);
-   if (shm == (int *)-1) {
-        perror("shmat");
-        exit(1);
-    }
-
-    sem_wait(semid, MUTEX);
-    if (shm[TIME_OFFSET] >= 240) {
-        sem_signal(semid, COOK_SEM);
-        sem_signal(semid, COOK_SEM); // Signal both cooks
-    }
-    sem_signal(semid, MUTEX);
-
-   while (shm[END_SESSION_OFFSET] < 7) {
-       usleep(100000);  // Sleep for a short time
-   }
-   shmdt(shm);
-   
-    // Clean up IPC resources
-    if (shmctl(shmid, IPC_RMID, NULL) == -1) {
-        perror("shmctl");
-    }
-    
-    if (semctl(semid, 0, IPC_RMID, 0) == -1) {
-        perror("semctl");
-    }
-    
-    printf("Customer: IPC resources cleaned up\n");
-    
-    return 0;
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/ipc.h>
+#include <sys/shm.h>
+#include <sys/sem.h>
+#include <sys/wait.h>
+#include <signal.h>
+#include <time.h>
+
+#include "restaurant.h"
+#include "affinity.h"
+#include "spinwait.h"
+#include "ipc.h"
+#include "detsched.h"
+#include "menu.h"
+#include "engine.h"
+
+// Global variables
+int shmid, semid;
+int log_mode = LOG_LINE;
+
+// Flush this customer's output, add its log counts and profile to the
+// session totals and terminate
+static void customer_exit(struct shm_segment *shm) {
+    unsigned long events, writes;
+    log_flush();
+    log_stats(&events, &writes);
+    prof_add(&shm->customer_prof);
+    __atomic_add_fetch(&shm->log_events, events, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&shm->log_writes, writes, __ATOMIC_RELAXED);
+    if (det != NULL) det_exit();
+    shmdt(shm);
+    exit(0);
+}
+
+// The steps of a meal, shared by customer processes and the coroutines
+// of customer -a; each is one critical section
+
+// The waiter has placed the order
+static void order_placed(struct shm_segment *shm, int customer_id) {
+    struct customer_record *rec = &shm->customers[customer_id];
+    sem_wait(semid, MUTEX);
+    int current_time = observe_time(shm);
+    char waiter_name = 'U' + rec->waiter_id;
+    sem_signal(semid, MUTEX);
+    
+    log_event(current_time, " \t", "Customer %d: Order placed to Waiter %c\n",
+              customer_id, waiter_name);
+}
+
+// The waiter has served the food, and marked the party served
+static void food_served(struct shm_segment *shm, int customer_id) {
+    struct customer_record *rec = &shm->customers[customer_id];
+    
+    // Print food received message with timestamp and waiting time
+    sem_wait(semid, MUTEX);
+    int current_time = observe_time(shm);
+    int waiting_time = rec->served_at - rec->arrival_time;
+    sem_signal(semid, MUTEX);
+    
+    log_event(current_time, " \t\t", "Customer %d gets food [Waiting time = %d]\n",
+              customer_id, waiting_time);
+}
+
+// Minutes left to eat (30 minutes by default); a restored diner only eats
+// what is left
+static int eat_minutes(struct shm_segment *shm, int customer_id) {
+    struct customer_record *rec = &shm->customers[customer_id];
+    sem_wait(semid, MUTEX);
+    int eat_time = rec->served_at + shm->config.eat_minutes - shm->time;
+    sem_signal(semid, MUTEX);
+    if (eat_time < 0) eat_time = 0;
+    return eat_time;
+}
+
+// Finished eating: free the table
+static void leave(struct shm_segment *shm, int customer_id) {
+    // Print message that customer has finished eating and is leaving
+    sem_wait(semid, MUTEX);
+    int current_time = observe_time(shm);
+    log_event(current_time, " \t\t\t", "Customer %d finishes eating and leaves\n",
+              customer_id);
+    
+    // Free the table
+    if (++shm->empty_tables > shm->config.num_tables) {
+        invariant_failed(shm, "Customer %d freed a table: %d of %d empty", customer_id,
+                         shm->empty_tables, shm->config.num_tables);
+    }
+    shm->customers[customer_id].state = CUST_LEFT;
+    sem_signal(semid, MUTEX);
+}
+
+// Wait for service once seated: order taken, food served, eat, leave.
+// A customer restored from a snapshot joins at the step its record showed
+// then. The state is passed in rather than read from the record, which
+// the waiter may already have moved on.
+void dine(struct shm_segment *shm, int customer_id, int state) {
+
+    if (state == CUST_SEATED) {
+        // Wait for waiter to take order
+        sem_wait(semid, CUSTOMER_BASE_SEM + customer_id);
+        order_placed(shm, customer_id);
+    }
+    
+    int eat_time = shm->config.eat_minutes;
+    if (state != CUST_SERVED) {
+        // Wait for food to be served
+        sem_wait(semid, CUSTOMER_BASE_SEM + customer_id);
+        food_served(shm, customer_id);
+    } else {
+        eat_time = eat_minutes(shm, customer_id);
+    }
+    
+    // Eat food
+    update_time(shm, semid, eat_time);
+    leave(shm, customer_id);
+}
+
+// A new party comes in. Returns -1 if it is turned away, else it is seated
+// and its waiter has been signalled.
+static int arrive(struct shm_segment *shm, int customer_id, int arrival_time, int customer_cnt) {
+    // Move the clock to the arrival time, unless other actors have already
+    // moved it further
+    sem_wait(semid, MUTEX);
+    if (observe_time(shm) < arrival_time) shm->time = arrival_time;
+    shm->last_customer = customer_id;
+    
+    // Print arrival message with timestamp
+    log_event(arrival_time, " ", "Customer %d arrives (count = %d)\n",
+              customer_id, customer_cnt);
+    
+    struct customer_record *rec = &shm->customers[customer_id];
+    rec->arrival_time = arrival_time;
+    rec->count = customer_cnt;
+    
+    // Check if it's after closing (3:00pm, 240 minutes after 11:00am, by default)
+    if (shm->time >= shm->config.closing_time) {
+        log_event(arrival_time, "\t\t\t\t\t\t", "Customer %d leaves (late arrival)\n",
+                  customer_id);
+        rec->state = CUST_LATE;
+        sem_signal(semid, MUTEX);
+        return -1;
+    }
+    
+    // Check if a table is available
+    if (shm->empty_tables <= 0) {
+        log_event(arrival_time, "\t\t\t\t\t\t", "Customer %d leaves (no empty table)\n",
+                  customer_id);
+        rec->state = CUST_NO_TABLE;
+        sem_signal(semid, MUTEX);
+        return -1;
+    }
+    
+    // Estimate the wait with the waiter this party would get, and leave
+    // rather than join a backlog longer than the limit
+    int waiter_num = shm->next_waiter;
+    struct waiter_queue *wq = &shm->waiters[waiter_num];
+    rec->predicted = predict_wait(shm, waiter_num);
+    if (shm->config.max_wait > 0 && rec->predicted > shm->config.max_wait) {
+        log_event(arrival_time, "\t\t\t\t\t\t", "Customer %d leaves (kitchen too busy, predicted wait = %d)\n",
+                  customer_id, rec->predicted);
+        rec->state = CUST_TOO_BUSY;
+        sem_signal(semid, MUTEX);
+        return -1;
+    }
+    if (QUEUED(wq) == WAITER_QUEUE_SIZE) {
+        fprintf(stderr, "Customer %d: queue of Waiter %c overflowed\n", customer_id, 'U' + waiter_num);
+        exit(1);
+    }
+    
+    // Use an empty table and take the waiter, in one critical section so
+    // a snapshot never sees a table taken by nobody's order
+    shm->empty_tables--;
+    shm->next_waiter = (waiter_num + 1) % NUM_WAITERS;
+    
+    // Add customer to waiter's queue
+    slab_ref ref = slab_alloc(&shm->heap, sizeof(struct seat_request));
+    if (ref == 0) {
+        fprintf(stderr, "Customer %d: out of shared memory for seat requests\n", customer_id);
+        exit(1);
+    }
+    struct seat_request *request = slab_ptr(&shm->heap, ref);
+    request->customer_id = customer_id;
+    request->count = customer_cnt;
+    wq->entries[wq->back % WAITER_QUEUE_SIZE] = ref;
+    
+    // Update back of queue
+    wq->back++;
+    
+    rec->state = CUST_SEATED;
+    rec->waiter_id = waiter_num;
+    
+    sem_signal(semid, MUTEX);
+    
+    // Signal waiter to take the order
+    wake_waiter(shm, semid, waiter_num);
+    return 0;
+}
+
+// Customer implementation
+void cmain(int customer_id, int arrival_time, int customer_cnt) {
+    // Attach to shared memory
+    struct shm_segment *shm = shmat(shmid, NULL, 0);
+    if (shm == (void *)-1) {
+        perror("shmat");
+        exit(1);
+    }
+    det_attach(shm, semid);
+    
+    if (arrive(shm, customer_id, arrival_time, customer_cnt) == 0) {
+        dine(shm, customer_id, CUST_SEATED);
+    }
+    
+    // Detach from shared memory and exit
+    customer_exit(shm);
+}
+
+// A customer of customer -a: the same meal as a process, as a coroutine
+// of the event loop. It sleeps on the wheel until its arrival minute and
+// takes the waiter's notifications from its counter.
+struct diner {
+    struct task task;           // first, so a task is its diner
+    struct shm_segment *shm;
+    int id;
+    int arrival;                // minutes after the first arrival
+    int arrival_time;
+    int count;
+    int state;                  // where a restored diner starts
+    int start;                  // clock when it started eating
+    int eat_time;
+};
+
+static struct engine engine;
+static struct diner diners[MAX_CUSTOMERS];
+
+static void diner_step(struct task *task) {
+    struct diner *d = (struct diner *)task;
+    struct shm_segment *shm = d->shm;
+
+    TASK_BEGIN(task);
+    if (d->state == CUST_NONE) {
+        TASK_SLEEP_UNTIL(&engine, task, d->arrival);
+        if (arrive(shm, d->id, d->arrival_time, d->count) == -1) TASK_EXIT(task);
+        d->state = CUST_SEATED;
+    }
+    if (d->state == CUST_SEATED) {
+        TASK_WAIT(&engine, task);
+        order_placed(shm, d->id);
+    }
+    d->eat_time = shm->config.eat_minutes;
+    if (d->state != CUST_SERVED) {
+        TASK_WAIT(&engine, task);
+        food_served(shm, d->id);
+    } else {
+        d->eat_time = eat_minutes(shm, d->id);
+    }
+    d->start = shm->time;
+    TASK_SLEEP(&engine, task, d->eat_time);
+    advance_time(shm, semid, d->start + d->eat_time);
+    leave(shm, d->id);
+    TASK_END(task);
+}
+
+// Add a diner arriving the given minutes after the first, or one
+// restored from a snapshot in the given state
+static void add_diner(struct shm_segment *shm, int customer_id, int arrival,
+                      int arrival_time, int customer_cnt, int state) {
+    struct diner *d = &diners[customer_id];
+    d->shm = shm;
+    d->id = customer_id;
+    d->arrival = arrival;
+    d->arrival_time = arrival_time;
+    d->count = customer_cnt;
+    d->state = state;
+    engine_spawn(&engine, &d->task, diner_step, &shm->customers[customer_id].notify);
+}
+
+// Fork a customer process and remember its pid
+static void spawn_customer(pid_t **child_pids, int *num_customers, FILE *fp,
+                           struct shm_segment *shm, int customer_id,
+                           int arrival_time, int customer_cnt, int restored) {
+    // Expand the array of PIDs
+    (*num_customers)++;
+    *child_pids = realloc(*child_pids, *num_customers * sizeof(pid_t));
+    if (*child_pids == NULL) {
+        perror("realloc");
+        exit(1);
+    }
+    
+    // Fork a new process for this customer
+    if (det != NULL) det_register(DET_CUSTOMER(customer_id));
+    log_flush();
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("fork");
+        exit(1);
+    } else if (pid == 0) {
+        // Child process (customer)
+        fclose(fp);  // Close the file in the child
+        free(*child_pids);  // Free the array in the child
+        log_init(log_mode);
+        prof_start();
+        perturb_init(&shm->config, DET_CUSTOMER(customer_id));
+        if (det != NULL) det_begin(DET_CUSTOMER(customer_id));
+        
+        if (restored) {
+            dine(shm, customer_id, shm->customers[customer_id].resume_state);
+            customer_exit(shm);
+        }
+        shmdt(shm);
+        cmain(customer_id, arrival_time, customer_cnt);  // This never returns
+        exit(0);
+    }
+    
+    // Parent process
+    (*child_pids)[*num_customers - 1] = pid;
+}
+
+static int compare_int(const void *a, const void *b) {
+    return *(const int *)a - *(const int *)b;
+}
+
+// Check the session's invariants once everyone has left: every party
+// that was seated was served exactly once and left, parties turned away
+// were never served, and every table is free again. Violations found
+// while running (clock going back, a table freed twice, a party served
+// twice) are in the count already.
+static void check_invariants(struct shm_segment *shm) {
+    for (int id = 1; id < MAX_CUSTOMERS; id++) {
+        const struct customer_record *rec = &shm->customers[id];
+        if (CUST_IN_RESTAURANT(rec->state)) {
+            invariant_failed(shm, "Customer %d still in the restaurant (state %d)", id, rec->state);
+        } else if (rec->state == CUST_LEFT && rec->times_served != 1) {
+            invariant_failed(shm, "Customer %d left after being served %d times", id,
+                             rec->times_served);
+        } else if (rec->state != CUST_LEFT && rec->times_served != 0) {
+            invariant_failed(shm, "Customer %d turned away but served", id);
+        }
+    }
+    if (shm->empty_tables != shm->config.num_tables) {
+        invariant_failed(shm, "%d of %d tables empty at the end", shm->empty_tables,
+                         shm->config.num_tables);
+    }
+    log_printf("Customer: Invariants: %d violated\n", shm->violations);
+}
+
+// Session totals from the customer records, on one key=value line that
+// sweep parses: parties served and their persons, parties turned away,
+// and percentiles of the wait from arrival to food. Also how often
+// waiters held back orders and how far off the predicted waits were.
+static void print_summary(const struct shm_segment *shm) {
+    int waits[MAX_CUSTOMERS];
+    int served = 0, persons = 0, no_table = 0, late = 0, too_busy = 0;
+    long error = 0;
+
+    for (int id = 1; id < MAX_CUSTOMERS; id++) {
+        const struct customer_record *rec = &shm->customers[id];
+        if (rec->state == CUST_SERVED || rec->state == CUST_LEFT) {
+            waits[served] = rec->served_at - rec->arrival_time;
+            error += abs(waits[served] - rec->predicted);
+            served++;
+            persons += rec->count;
+        } else if (rec->state == CUST_NO_TABLE) {
+            no_table++;
+        } else if (rec->state == CUST_LATE) {
+            late++;
+        } else if (rec->state == CUST_TOO_BUSY) {
+            too_busy++;
+        }
+    }
+    qsort(waits, served, sizeof(int), compare_int);
+
+    int pct[3] = {50, 90, 99}, value[3] = {0, 0, 0};
+    for (int i = 0; i < 3 && served > 0; i++) {
+        value[i] = waits[(pct[i] * served + 99) / 100 - 1];  // nearest rank
+    }
+    log_printf("Customer: Summary: served=%d persons=%d no_table=%d late=%d too_busy=%d "
+               "wait_p50=%d wait_p90=%d wait_p99=%d wait_max=%d end=%d deferred=%d "
+               "violations=%d predict_err=%.1f\n",
+               served, persons, no_table, late, too_busy, value[0], value[1], value[2],
+               served > 0 ? waits[served - 1] : 0, shm->time, shm->deferrals,
+               shm->violations, served > 0 ? (double)error / served : 0.0);
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr, "Usage: %s [-c cpus] [-f fifo_prio] [-n nice] [-b] [-i customers_file] [-a]\n", prog);
+    exit(1);
+}
+
+int main(int argc, char *argv[]) {
+    FILE *fp;
+    int customer_id, arrival_time, customer_cnt;
+    int last_arrival_time = 0;
+    
+    key_t key_shm, key_sem;
+    struct sched_opts sched = {0};
+    int opt;
+    const char *customers_path = "customers.txt";
+    int async = 0;
+    int offset = 0;             // minutes after the first arrival, with -a
+
+    while ((opt = getopt(argc, argv, "c:f:n:bi:a")) != -1) {
+        if (opt == 'b') log_mode = LOG_BUFFERED;
+        else if (opt == 'i') customers_path = optarg;
+        else if (opt == 'a') async = 1;
+        else if (parse_sched_option(opt, optarg, &sched) == -1) usage(argv[0]);
+    }
+    log_init(log_mode);
+
+    // Customers share the cores left over from the staff; children inherit
+    // this process's affinity and scheduling policy.
+    apply_sched_opts(&sched, -1);
+    
+    // Generate keys for IPC
+    ipc_keys(&key_shm, &key_sem);
+    
+    // Get shared memory and semaphores of the running session
+    unsigned generation = ipc_attach(key_shm, key_sem, &shmid, &semid);
+    struct shm_segment *shm = shmat(shmid, NULL, 0);
+    if (shm == (void *)-1) {
+        perror("shmat");
+        exit(1);
+    }
+    shm->header.customer_pid = getpid();
+    det_attach(shm, semid);
+    
+    log_printf("Customer: IPC resources attached (generation %u)\n", generation);
+    
+    // With -a this process runs every customer itself; waiters notify it
+    // through ENGINE_SEM from the first arrival on
+    if (async) {
+        if (det != NULL) {
+            fprintf(stderr, "%s: -a cannot be used in a deterministic session\n", argv[0]);
+            exit(1);
+        }
+        engine_init(&engine, semid, shm->config.scale);
+        perturb_init(&shm->config, DET_PARENT);
+        shm->engine = 1;
+        log_printf("Customer: Running customers as coroutines of one event loop\n");
+    }
+    
+    // Open customer file
+    fp = fopen(customers_path, "r");
+    if (fp == NULL) {
+        perror(customers_path);
+        exit(1);
+    }
+    
+    log_printf("Customer: Processing customer arrivals from %s\n", customers_path);
+    
+    // Array to store child PIDs
+    pid_t *child_pids = NULL;
+    int num_customers = 0;
+    int last_customer = 0;
+    
+    // Bring back the parties that were in the restaurant when the snapshot
+    // this session was restored from was taken
+    if (shm->restored) {
+        last_customer = shm->last_customer;
+        last_arrival_time = shm->time;
+        for (int id = 1; id < MAX_CUSTOMERS; id++) {
+            int state = shm->customers[id].resume_state;
+            if (!CUST_IN_RESTAURANT(shm->customers[id].state)) continue;
+            log_printf("Customer: Resuming customer %d (state %d)\n", id, state);
+            if (async) {
+                add_diner(shm, id, 0, 0, 0, state);
+                num_customers++;
+            } else {
+                spawn_customer(&child_pids, &num_customers, fp, shm, id, 0, 0, 1);
+            }
+        }
+    }
+    
+    // In a deterministic session this process is an actor too: it takes the
+    // first baton once all the staff are there, and paces arrivals on the
+    // virtual clock
+    if (det != NULL) {
+        log_printf("Customer: Deterministic mode, seed %u\n", det->seed);
+        det_start(DET_PARENT, shm->config.num_cooks + NUM_WAITERS);
+    }
+    
+    // Read customer information from file
+    while (fscanf(fp, "%d %d %d", &customer_id, &arrival_time, &customer_cnt) == 3) {
+        if (customer_id == -1) {
+            break;  // End of file marker
+        }
+        
+        // Validate customer data
+        if (customer_id <= 0 || customer_id >= MAX_CUSTOMERS || arrival_time < 0 ||
+            customer_cnt < 1 || customer_cnt > 4) {
+            log_printf("Invalid customer data: ID=%d, arrival=%d, count=%d. Skipping.\n",
+                   customer_id, arrival_time, customer_cnt);
+            continue;
+        }
+        
+        // Skip customers that already arrived before the snapshot
+        if (customer_id <= last_customer) continue;
+        
+        // Wait for the specified interval between customers
+        if (num_customers > 0) {
+            int wait_time = arrival_time - last_arrival_time;
+            if (wait_time > 0) {
+                if (async) offset += wait_time;
+                else if (det != NULL) det_sleep(wait_time);
+                else usleep(wait_time * shm->config.scale);
+            }
+        }
+        
+        last_arrival_time = arrival_time;
+        
+        if (async) {
+            add_diner(shm, customer_id, offset, arrival_time, customer_cnt, CUST_NONE);
+            num_customers++;
+            continue;
+        }
+        spawn_customer(&child_pids, &num_customers, fp, shm,
+                       customer_id, arrival_time, customer_cnt, 0);
+    }
+    
+    fclose(fp);
+    
+    // Run the meals; the customers' log counts and profile are this
+    // process's
+    if (async) {
+        unsigned long events, writes;
+        prof_start();
+        engine_run(&engine);
+        log_flush();
+        log_stats(&events, &writes);
+        prof_add(&shm->customer_prof);
+        shm->log_events += events;
+        shm->log_writes += writes;
+        num_customers = 0;
+    }
+    
+    // Wait for all child processes to terminate
+    if (det != NULL) det_wait_done(DET_CUSTOMERS);
+    for (int i = 0; i < num_customers; i++) {
+        waitpid(child_pids[i], NULL, 0);
+    }
+    
+    free(child_pids);
+    
+    int num_cooks = shm->config.num_cooks;
+    sem_wait(semid, MUTEX);
+    if (shm->time >= shm->config.closing_time) {
+        for (int i = 0; i < num_cooks; i++) {
+            wake_cook(shm, semid, shm->menu.cook_station[i]);  // Signal every cook
+        }
+    }
+    sem_signal(semid, MUTEX);
+
+   if (det != NULL) det_wait_done(DET_STAFF);
+   while (shm->end_session < num_cooks + NUM_WAITERS) {
+       // The last one may have counted out and exited since the test above
+       if (!session_staff_alive(shm) &&
+           __atomic_load_n(&shm->end_session, __ATOMIC_ACQUIRE) < num_cooks + NUM_WAITERS) {
+           log_printf("Customer: Staff exited without ending the session\n");
+           invariant_failed(shm, "staff exited without ending the session");
+           break;
+       }
+       usleep(100000);  // Sleep for a short time
+   }
+   // Staff count themselves out under MUTEX and touch no semaphore after
+   // releasing it, so once the last one has let go the set can be removed
+   sem_wait(semid, MUTEX);
+   sem_signal(semid, MUTEX);
+
+   check_invariants(shm);
+   print_summary(shm);
+   slab_report("Customer", &shm->heap, det == NULL);
+   log_report("Customer processes", shm->log_events, shm->log_writes);
+   if (det == NULL) prof_report("Customer processes", &shm->customer_prof);
+   if (async) engine_report("Customer", &engine);
+   if (det != NULL) {
+       det_report("Customer");
+       det_exit();
+   }
+   int violations = shm->violations;
+   shmdt(shm);
+   
+    // Clean up IPC resources
+    if (shmctl(shmid, IPC_RMID, NULL) == -1) {
+        perror("shmctl");
+    }
+    
+    if (semctl(semid, 0, IPC_RMID, 0) == -1) {
+        perror("semctl");
+    }
+    
+    log_printf("Customer: IPC resources cleaned up\n");
+    
+    return violations > 0 ? 1 : 0;
 }
\ No newline at end of file
@@ -0,0 +1,199 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/sem.h>
+
+#include "detsched.h"
+
+struct det_state *det = NULL;
+static int det_semid = -1;
+static int det_self = -1;
+
+// Mix the seed and the actor number into a tie-break priority
+static unsigned det_priority(unsigned seed, int actor) {
+    unsigned x = seed * 0x9e3779b9u ^ (actor + 1) * 0x85ebca6bu;
+    x ^= x >> 16;
+    x *= 0x7feb352du;
+    x ^= x >> 15;
+    x *= 0x846ca68bu;
+    x ^= x >> 16;
+    return x;
+}
+
+static int det_class(int actor) {
+    return actor < DET_PARENT ? DET_STAFF : DET_CUSTOMERS;
+}
+
+// Take (-1) or hand over (+1) an actor's baton semaphore
+static void baton_op(int actor, int op) {
+    struct sembuf sb = {DET_BASE_SEM + actor, op, 0};
+    while (semop(det_semid, &sb, 1) == -1) {
+        if (errno != EINTR) {
+            perror("semop baton");
+            exit(1);
+        }
+    }
+}
+
+// Set up a deterministic session in a new segment (cook, before publishing)
+void det_init(struct shm_segment *shm, unsigned seed) {
+    memset(&shm->det, 0, sizeof(shm->det));
+    shm->det.enabled = 1;
+    shm->det.seed = seed;
+    shm->det.running = -1;
+}
+
+// Route this process's waits through the scheduler if the session is
+// deterministic
+void det_attach(struct shm_segment *shm, int semid) {
+    det = shm->det.enabled ? &shm->det : NULL;
+    det_semid = semid;
+}
+
+// Add an actor that will start running when first scheduled. Staff are
+// registered before the start, in any order, and are queued by actor
+// number when the customer parent starts the schedule.
+void det_register(int actor) {
+    struct det_actor *a = &det->actors[actor];
+    a->priority = det_priority(det->seed, actor);
+    a->state = DET_RUNNABLE;
+    if (det->started) {
+        a->seq = det->next_seq++;
+        det->live[det_class(actor)]++;
+    } else {
+        __atomic_add_fetch(&det->live[det_class(actor)], 1, __ATOMIC_RELAXED);
+        __atomic_add_fetch(&det->registered, 1, __ATOMIC_RELEASE);
+    }
+}
+
+// First thing a registered actor does: wait to be scheduled
+void det_begin(int actor) {
+    det_self = actor;
+    baton_op(actor, -1);
+}
+
+// Wait for every cook and waiter to register, then take the first baton
+void det_start(int actor, int num_staff) {
+    while (__atomic_load_n(&det->registered, __ATOMIC_ACQUIRE) < num_staff) {
+        usleep(1000);
+    }
+    for (int i = 0; i < DET_MAX_ACTORS; i++) {
+        if (det->actors[i].state == DET_RUNNABLE) det->actors[i].seq = det->next_seq++;
+    }
+    det_self = actor;
+    det->actors[actor].priority = det_priority(det->seed, actor);
+    det->actors[actor].state = DET_RUNNING;
+    det->running = actor;
+    det->started = 1;
+}
+
+// The next actor to run, advancing the clock to the next wakeup if nobody
+// is runnable. -1 if there is nobody left.
+static int det_pick(void) {
+    int best = -1;
+    for (int i = 0; i < DET_MAX_ACTORS; i++) {
+        struct det_actor *a = &det->actors[i];
+        if (a->state == DET_RUNNABLE && (best == -1 || a->seq < det->actors[best].seq)) {
+            best = i;
+        }
+    }
+    if (best != -1) return best;
+
+    for (int i = 0; i < DET_MAX_ACTORS; i++) {
+        struct det_actor *a = &det->actors[i];
+        if (a->state != DET_SLEEPING) continue;
+        if (best == -1 || a->wake < det->actors[best].wake ||
+            (a->wake == det->actors[best].wake && a->priority < det->actors[best].priority)) {
+            best = i;
+        }
+    }
+    if (best != -1 && det->actors[best].wake > det->now) {
+        det->now = det->actors[best].wake;
+    }
+    return best;
+}
+
+// Hand the baton to the next actor and, unless this one has exited, wait
+// until it comes back
+static void det_switch(int wait) {
+    log_flush();
+    int next = det_pick();
+    if (next == -1) {
+        for (int i = 0; i < DET_MAX_ACTORS; i++) {
+            if (det->actors[i].state == DET_BLOCKED) {
+                fprintf(stderr, "Deterministic schedule stalled at %s: actor %d "
+                                "blocked on semaphore %d and nothing else can run\n",
+                        get_time_string(det->now), i, det->actors[i].semnum);
+                exit(1);
+            }
+        }
+        return;
+    }
+
+    det->actors[next].state = DET_RUNNING;
+    det->running = next;
+    det->switches++;
+    if (next == det_self) return;
+    baton_op(next, 1);
+    if (wait) baton_op(det_self, -1);
+}
+
+void det_wait(int semnum) {
+    if (det->counts[semnum] > 0) {
+        det->counts[semnum]--;
+        return;
+    }
+    struct det_actor *a = &det->actors[det_self];
+    a->state = DET_BLOCKED;
+    a->semnum = semnum;
+    a->seq = det->next_seq++;
+    det_switch(1);
+}
+
+// Wake the actor that blocked on semnum first, or count the post. The
+// caller keeps running.
+void det_signal(int semnum) {
+    int best = -1;
+    for (int i = 0; i < DET_MAX_ACTORS; i++) {
+        struct det_actor *a = &det->actors[i];
+        if (a->state == DET_BLOCKED && a->semnum == semnum &&
+            (best == -1 || a->seq < det->actors[best].seq)) {
+            best = i;
+        }
+    }
+    if (best == -1) {
+        det->counts[semnum]++;
+        return;
+    }
+    det->actors[best].state = DET_RUNNABLE;
+    det->actors[best].seq = det->next_seq++;
+}
+
+void det_sleep(int minutes) {
+    struct det_actor *a = &det->actors[det_self];
+    a->state = DET_SLEEPING;
+    a->wake = det->now + minutes;
+    det_switch(1);
+}
+
+// Block the customer parent until every actor of a class has exited
+void det_wait_done(int cls) {
+    if (det->live[cls] > 0) det_wait(DET_DONE_SEM(cls));
+}
+
+// Leave the schedule for good; call after the actor's last output
+void det_exit(void) {
+    det->actors[det_self].state = DET_DONE;
+    if (det_self != DET_PARENT) {
+        int cls = det_class(det_self);
+        if (--det->live[cls] == 0) det_signal(DET_DONE_SEM(cls));
+    }
+    det_switch(0);
+}
+
+void det_report(const char *name) {
+    log_printf("%s: deterministic schedule: seed=%u switches=%lu end=%s\n",
+               name, det->seed, det->switches, get_time_string(det->now));
+}
@@ -0,0 +1,16 @@
+#ifndef DETSCHED_H
+#define DETSCHED_H
+
+#include "restaurant.h"
+
+void det_init(struct shm_segment *shm, unsigned seed);
+void det_attach(struct shm_segment *shm, int semid);
+void det_register(int actor);
+void det_begin(int actor);
+void det_start(int actor, int num_staff);
+void det_sleep(int minutes);
+void det_wait_done(int cls);
+void det_exit(void);
+void det_report(const char *name);
+
+#endif
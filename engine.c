@@ -0,0 +1,176 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/sem.h>
+
+#include "restaurant.h"
+#include "engine.h"
+
+static void make_ready(struct engine *e, struct task *task) {
+    task->next = NULL;
+    if (e->ready_tail != NULL) e->ready_tail->next = task;
+    else e->ready = task;
+    e->ready_tail = task;
+}
+
+// File a timer in the lowest level whose range covers it; one already due
+// runs straight away
+static void wheel_insert(struct engine *e, struct task *task) {
+    struct timing_wheel *w = &e->wheel;
+    long long delta = task->expires - w->now;
+    if (delta <= 0) {
+        make_ready(e, task);
+        return;
+    }
+    int level = 0;
+    while (level + 1 < WHEEL_LEVELS && delta >= 1LL << (WHEEL_BITS * (level + 1))) level++;
+    int slot = (task->expires >> (WHEEL_BITS * level)) & WHEEL_MASK;
+    task->next = w->slots[level][slot];
+    w->slots[level][slot] = task;
+    w->count++;
+}
+
+// Re-file the timers of the current slot of a level, which now fall in
+// the range of the levels below
+static void cascade(struct engine *e, int level) {
+    struct timing_wheel *w = &e->wheel;
+    int slot = (w->now >> (WHEEL_BITS * level)) & WHEEL_MASK;
+    struct task *task = w->slots[level][slot];
+    w->slots[level][slot] = NULL;
+    while (task != NULL) {
+        struct task *next = task->next;
+        w->count--;
+        wheel_insert(e, task);
+        task = next;
+    }
+}
+
+// Move the wheel one tick on and make its due timers ready
+static void wheel_tick(struct engine *e) {
+    struct timing_wheel *w = &e->wheel;
+    w->now++;
+    int level = 0;
+    while (level + 1 < WHEEL_LEVELS && ((w->now >> (WHEEL_BITS * level)) & WHEEL_MASK) == 0) level++;
+    for (; level > 0; level--) cascade(e, level);
+    cascade(e, 0);
+}
+
+// Tick the next timer may be due at: a level-0 slot, or else the next
+// time level 0 wraps and a higher slot comes down
+static long long wheel_next(const struct timing_wheel *w) {
+    for (int i = 1; i < WHEEL_SIZE; i++) {
+        if (w->slots[0][(w->now + i) & WHEEL_MASK] != NULL) return w->now + i;
+    }
+    return (w->now | WHEEL_MASK) + 1;
+}
+
+void engine_init(struct engine *e, int semid, int scale) {
+    *e = (struct engine){0};
+    e->semid = semid;
+    e->start_ns = now_ns();
+    e->tick_ns = scale * 1000LL / ENGINE_TICKS_PER_MINUTE;
+    if (e->tick_ns < 1) e->tick_ns = 1;
+}
+
+// Start a task at its first step; notify is the counter it waits on
+void engine_spawn(struct engine *e, struct task *task, void (*step)(struct task *),
+                  const unsigned *notify) {
+    task->line = 0;
+    task->step = step;
+    task->notify = notify;
+    task->seen = notify != NULL ? __atomic_load_n(notify, __ATOMIC_ACQUIRE) : 0;
+    e->live++;
+    make_ready(e, task);
+}
+
+static long long current_tick(const struct engine *e) {
+    return (now_ns() - e->start_ns) / e->tick_ns;
+}
+
+// Minutes from now, measured from the real clock rather than the wheel,
+// which may be behind
+void engine_sleep(struct engine *e, struct task *task, int minutes) {
+    task->expires = current_tick(e) + (long long)minutes * ENGINE_TICKS_PER_MINUTE;
+    wheel_insert(e, task);
+}
+
+// Minutes after the engine started, so that arrivals do not drift
+void engine_sleep_until(struct engine *e, struct task *task, int minute) {
+    task->expires = (long long)minute * ENGINE_TICKS_PER_MINUTE;
+    wheel_insert(e, task);
+}
+
+void engine_wait(struct engine *e, struct task *task) {
+    task->next = e->waiting;
+    e->waiting = task;
+}
+
+// Take one notification for every waiting task that has one
+static void collect_notified(struct engine *e) {
+    struct task **link = &e->waiting;
+    while (*link != NULL) {
+        struct task *task = *link;
+        if (__atomic_load_n(task->notify, __ATOMIC_ACQUIRE) != task->seen) {
+            task->seen++;
+            e->notified++;
+            *link = task->next;
+            make_ready(e, task);
+        } else {
+            link = &task->next;
+        }
+    }
+}
+
+// Block until a waiter posts ENGINE_SEM or the next timer is due
+static void engine_block(struct engine *e) {
+    struct timespec timeout, *tp = NULL;
+    if (e->wheel.count > 0) {
+        long long ns = e->start_ns + wheel_next(&e->wheel) * e->tick_ns - now_ns();
+        if (ns <= 0) return;
+        timeout.tv_sec = ns / 1000000000LL;
+        timeout.tv_nsec = ns % 1000000000LL;
+        tp = &timeout;
+    }
+    struct sembuf sb = {ENGINE_SEM, -1, 0};
+    long long start = now_ns();
+    int r = semtimedop(e->semid, &sb, 1, tp);
+    PROF(work_wait, PROF_WORK, start);
+    if (r == -1) {
+        if (errno == EAGAIN) e->timeouts++;
+        else if (errno != EINTR) {
+            perror("semtimedop");
+            exit(1);
+        }
+    }
+}
+
+// Run until every task has finished
+void engine_run(struct engine *e) {
+    while (e->live > 0) {
+        e->loops++;
+        long long target = current_tick(e);
+        if (e->wheel.count == 0 && e->wheel.now < target) e->wheel.now = target;
+        while (e->wheel.now < target) wheel_tick(e);
+        collect_notified(e);
+
+        if (e->ready == NULL) {
+            engine_block(e);
+            continue;
+        }
+        // Steps may make tasks ready again; those run on the next pass
+        struct task *task = e->ready;
+        e->ready = e->ready_tail = NULL;
+        while (task != NULL) {
+            struct task *next = task->next;
+            task->step(task);
+            if (task->line == -1) e->live--;
+            task = next;
+        }
+    }
+}
+
+void engine_report(const char *name, const struct engine *e) {
+    log_printf("%s: engine: loops=%lu timeouts=%lu notified=%lu\n",
+               name, e->loops, e->timeouts, e->notified);
+}
@@ -0,0 +1,70 @@
+#ifndef ENGINE_H
+#define ENGINE_H
+
+// Event loop that runs many customers in one process (customer -a). Each
+// customer is a stackless coroutine: a step function that keeps its state
+// in a task record and returns whenever it has to wait, resuming at the
+// same point next time. A task waits either for a timer, kept in a
+// hierarchical timing wheel, or for a notification: a counter in shared
+// memory that the waiters bump before posting ENGINE_SEM. The loop
+// blocks in semtimedop on ENGINE_SEM until the next timer is due.
+
+#define ENGINE_TICKS_PER_MINUTE 16
+#define WHEEL_BITS 6
+#define WHEEL_SIZE (1 << WHEEL_BITS)
+#define WHEEL_MASK (WHEEL_SIZE - 1)
+#define WHEEL_LEVELS 4          // 2^24 ticks, over a million minutes
+
+struct task {
+    int line;                   // resume point, 0 = start, -1 = finished
+    void (*step)(struct task *task);
+    long long expires;          // tick the timer is due
+    const unsigned *notify;     // counter waited on
+    unsigned seen;              // notifications already taken
+    struct task *next;
+};
+
+// Level L holds timers due in fewer than 64^(L+1) ticks, in the slot of
+// their due tick's digit at that level. A slot of level L is moved down a
+// level when the lower digits of the clock wrap to zero.
+struct timing_wheel {
+    long long now;              // ticks since the engine started
+    int count;
+    struct task *slots[WHEEL_LEVELS][WHEEL_SIZE];
+};
+
+struct engine {
+    int semid;
+    long long start_ns;
+    long long tick_ns;
+    int live;                   // tasks not finished
+    struct timing_wheel wheel;
+    struct task *ready, *ready_tail;
+    struct task *waiting;       // on a notification
+    unsigned long loops, timeouts, notified;
+};
+
+// Coroutine body: TASK_BEGIN ... TASK_END around the step function.
+// Locals do not survive a wait; keep them in the task's record.
+#define TASK_BEGIN(task) switch ((task)->line) { case 0:
+#define TASK_END(task) } (task)->line = -1
+#define TASK_EXIT(task) do { (task)->line = -1; return; } while (0)
+
+// Arm a wait and return from the step; the next step resumes after it
+#define TASK_SLEEP(e, task, minutes) \
+    do { engine_sleep(e, task, minutes); (task)->line = __LINE__; return; case __LINE__:; } while (0)
+#define TASK_SLEEP_UNTIL(e, task, minute) \
+    do { engine_sleep_until(e, task, minute); (task)->line = __LINE__; return; case __LINE__:; } while (0)
+#define TASK_WAIT(e, task) \
+    do { engine_wait(e, task); (task)->line = __LINE__; return; case __LINE__:; } while (0)
+
+void engine_init(struct engine *e, int semid, int scale);
+void engine_spawn(struct engine *e, struct task *task, void (*step)(struct task *),
+                  const unsigned *notify);
+void engine_sleep(struct engine *e, struct task *task, int minutes);
+void engine_sleep_until(struct engine *e, struct task *task, int minute);
+void engine_wait(struct engine *e, struct task *task);
+void engine_run(struct engine *e);
+void engine_report(const char *name, const struct engine *e);
+
+#endif
@@ -1,35 +1,52 @@
-#include <stdio.h>
-#include <stdlib.h>
-#include <time.h>
-
-int main ( )
-{
-   int i, t, c, n;
-
-   srand((unsigned int)time(NULL));
-
-   t = n = 0;
-
-   i = 7;
-   while (i) {
-      ++n;
-      if (rand() % 2) c = 1;
-      else if (rand() % 2) c = 2;
-      else c = (rand() % 2) ? 3 : 4;
-      printf("%d %d %d\n", n, t, c);
-      --i;
-   }
-
-   while (1) {
-      ++n;
-      t += rand() % 10;
-      if (rand() % 2) c = 1;
-      else if (rand() % 2) c = 2;
-      else c = (rand() % 2) ? 3 : 4;
-      printf("%d %d %d\n", n, t, c);
-      if (t > 250) break;
-   }
-   printf("-1\n");
-
-   exit(0);
-}
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+int main (int argc, char *argv[])
+{
+   int i, t, c, n, count;
+
+   /* A seed on the command line gives a reproducible arrival trace */
+   if (argc > 1) srand((unsigned int)strtoul(argv[1], NULL, 0));
+   else srand((unsigned int)time(NULL));
+
+   /* With a count as well, that many customers arrive spread evenly over
+      the session and a little past closing, for stress runs */
+   if (argc > 2) {
+      count = atoi(argv[2]);
+      for (n = 1; n <= count; n++) {
+         t = (int)((long)(n - 1) * 260 / count);
+         if (rand() % 2) c = 1;
+         else if (rand() % 2) c = 2;
+         else c = (rand() % 2) ? 3 : 4;
+         printf("%d %d %d\n", n, t, c);
+      }
+      printf("-1\n");
+      exit(0);
+   }
+
+   t = n = 0;
+
+   i = 7;
+   while (i) {
+      ++n;
+      if (rand() % 2) c = 1;
+      else if (rand() % 2) c = 2;
+      else c = (rand() % 2) ? 3 : 4;
+      printf("%d %d %d\n", n, t, c);
+      --i;
+   }
+
+   while (1) {
+      ++n;
+      t += rand() % 10;
+      if (rand() % 2) c = 1;
+      else if (rand() % 2) c = 2;
+      else c = (rand() % 2) ? 3 : 4;
+      printf("%d %d %d\n", n, t, c);
+      if (t > 250) break;
+   }
+   printf("-1\n");
+
+   exit(0);
+}
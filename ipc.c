@@ -0,0 +1,214 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/ipc.h>
+#include <sys/shm.h>
+#include <sys/sem.h>
+
+#include "ipc.h"
+
+#define ATTACH_RETRIES 50
+#define ATTACH_RETRY_USEC 20000
+
+// Keys of the session's segment and semaphore set. RESTAURANT_IPC_KEY
+// gives a session its own pair of keys (the value and the value + 1) so
+// that several can run side by side.
+void ipc_keys(key_t *key_shm, key_t *key_sem) {
+    const char *env = getenv("RESTAURANT_IPC_KEY");
+    if (env != NULL) {
+        char *end;
+        long key = strtol(env, &end, 0);
+        if (*env == '\0' || *end != '\0' || key <= 0 || key >= 0x7fffffff) {
+            fprintf(stderr, "Invalid RESTAURANT_IPC_KEY: %s\n", env);
+            exit(1);
+        }
+        *key_shm = key;
+        *key_sem = key + 1;
+        return;
+    }
+
+    *key_shm = ftok("cook.c", 'R');
+    *key_sem = ftok("cook.c", 'S');
+    
+    if (*key_shm == -1 || *key_sem == -1) {
+        perror("ftok");
+        exit(1);
+    }
+}
+
+// A dead process that has not been reaped yet (a zombie) still answers
+// kill(pid, 0), so look at its state as well.
+int pid_alive(pid_t pid) {
+    if (pid <= 0 || (kill(pid, 0) == -1 && errno != EPERM)) return 0;
+
+    char path[32], state = 0;
+    sprintf(path, "/proc/%d/stat", (int)pid);
+    FILE *fp = fopen(path, "r");
+    if (fp == NULL) return 1;
+    if (fscanf(fp, "%*d (%*[^)]) %c", &state) != 1) state = 0;
+    fclose(fp);
+    return state != 'Z';
+}
+
+// True if any process that registered itself in the header still exists
+int session_owner_alive(const struct shm_segment *shm) {
+    const struct shm_header *hdr = &shm->header;
+    if (pid_alive(hdr->cook_pid) || pid_alive(hdr->waiter_pid) ||
+        pid_alive(hdr->customer_pid)) {
+        return 1;
+    }
+    return session_staff_alive(shm);
+}
+
+int session_staff_alive(const struct shm_segment *shm) {
+    for (int i = 0; i < MAX_COOKS + NUM_WAITERS; i++) {
+        if (pid_alive(shm->header.staff_pids[i])) return 1;
+    }
+    return 0;
+}
+
+// Remove the segment and semaphore set left under our keys by a session
+// whose processes are all gone. Returns -1 if the session is still live,
+// otherwise the generation of the removed segment (0 if unknown).
+static int reclaim_stale(key_t key_shm, key_t key_sem) {
+    unsigned generation = 0;
+    int old_shmid = shmget(key_shm, 0, 0);
+    if (old_shmid == -1) return 0;  // removed by its owner meanwhile
+
+    struct shmid_ds ds;
+    if (shmctl(old_shmid, IPC_STAT, &ds) == -1) {
+        perror("shmctl: IPC_STAT");
+        exit(1);
+    }
+
+    if (ds.shm_segsz == SHM_SIZE) {
+        struct shm_segment *old = shmat(old_shmid, NULL, SHM_RDONLY);
+        if (old == (void *)-1) {
+            perror("shmat");
+            exit(1);
+        }
+        int ours = old->header.magic == SHM_MAGIC && old->header.version == SHM_VERSION;
+        // A session that is still being set up (a restore, the semaphore
+        // values) has no magic yet but a live cook, or, in the moment
+        // before its header is written, a live creator
+        int starting = 0;
+        if (old->header.version == SHM_VERSION) starting = pid_alive(old->header.cook_pid);
+        else if (old->header.version == 0) starting = pid_alive(ds.shm_cpid);
+        if (starting || (ours && session_owner_alive(old))) {
+            shmdt(old);
+            return -1;
+        }
+        generation = ours ? old->header.generation : 0;
+        shmdt(old);
+    } else if (ds.shm_nattch > 0) {
+        // A segment from another layout that something still uses
+        return -1;
+    }
+
+    if (shmctl(old_shmid, IPC_RMID, NULL) == -1) {
+        perror("shmctl: IPC_RMID");
+        exit(1);
+    }
+    int old_semid = semget(key_sem, 0, 0);
+    if (old_semid != -1 && semctl(old_semid, 0, IPC_RMID) == -1) {
+        perror("semctl: IPC_RMID");
+        exit(1);
+    }
+
+    log_printf("Cook: Removed stale IPC resources (generation %u)\n", generation);
+    return generation;
+}
+
+// Create a fresh segment and semaphore set, reclaiming any stale ones left
+// by a crashed session. The segment is returned zeroed and attached, with
+// its header filled in but not yet published. Returns the new generation.
+unsigned ipc_create(key_t key_shm, key_t key_sem, int *shmid, int *semid,
+                    struct shm_segment **shm) {
+    unsigned generation = 1;
+
+    while ((*shmid = shmget(key_shm, SHM_SIZE, IPC_CREAT | IPC_EXCL | 0666)) == -1) {
+        if (errno != EEXIST) {
+            perror("shmget");
+            exit(1);
+        }
+        int old = reclaim_stale(key_shm, key_sem);
+        if (old == -1) {
+            fprintf(stderr, "Cook: A session is already running\n");
+            exit(1);
+        }
+        generation = old + 1;
+    }
+
+    while ((*semid = semget(key_sem, NUM_SEMS, IPC_CREAT | IPC_EXCL | 0666)) == -1) {
+        // A semaphore set without a segment can only be left over
+        int old_semid = semget(key_sem, 0, 0);
+        if (errno != EEXIST || old_semid == -1 || semctl(old_semid, 0, IPC_RMID) == -1) {
+            perror("semget");
+            exit(1);
+        }
+    }
+
+    *shm = shmat(*shmid, NULL, 0);
+    if (*shm == (void *)-1) {
+        perror("shmat");
+        exit(1);
+    }
+
+    // Zeroing the whole segment empties every queue
+    memset(*shm, 0, SHM_SIZE);
+    (*shm)->header.version = SHM_VERSION;
+    (*shm)->header.generation = generation;
+    (*shm)->header.cook_pid = getpid();
+    return generation;
+}
+
+// Mark the segment as fully initialized; attachers wait for this
+void ipc_publish(struct shm_segment *shm) {
+    __atomic_store_n(&shm->header.magic, SHM_MAGIC, __ATOMIC_RELEASE);
+}
+
+// Attach to the live session created by cook. Waits briefly for cook to
+// finish initializing, and refuses segments whose owner has died.
+// Returns the session generation.
+unsigned ipc_attach(key_t key_shm, key_t key_sem, int *shmid, int *semid) {
+    for (int attempt = 0; ; attempt++) {
+        *shmid = shmget(key_shm, SHM_SIZE, 0666);
+        if (*shmid != -1) {
+            struct shm_segment *shm = shmat(*shmid, NULL, SHM_RDONLY);
+            if (shm == (void *)-1) {
+                perror("shmat");
+                exit(1);
+            }
+            unsigned magic = __atomic_load_n(&shm->header.magic, __ATOMIC_ACQUIRE);
+            unsigned generation = shm->header.generation;
+            int live = pid_alive(shm->header.cook_pid);
+            shmdt(shm);
+
+            if (magic == SHM_MAGIC && live) {
+                *semid = semget(key_sem, NUM_SEMS, 0666);
+                if (*semid == -1) {
+                    perror("semget");
+                    exit(1);
+                }
+                return generation;
+            }
+            if (magic == SHM_MAGIC) {
+                fprintf(stderr, "Stale session (generation %u): cook is not running\n",
+                        generation);
+                exit(1);
+            }
+        } else if (errno != ENOENT) {
+            perror("shmget");
+            exit(1);
+        }
+
+        if (attempt == ATTACH_RETRIES) {
+            fprintf(stderr, "No session found: start ./cook first\n");
+            exit(1);
+        }
+        usleep(ATTACH_RETRY_USEC);
+    }
+}
@@ -0,0 +1,18 @@
+#ifndef IPC_H
+#define IPC_H
+
+#include <sys/types.h>
+
+#include "restaurant.h"
+
+void ipc_keys(key_t *key_shm, key_t *key_sem);
+int pid_alive(pid_t pid);
+int session_owner_alive(const struct shm_segment *shm);
+int session_staff_alive(const struct shm_segment *shm);
+
+unsigned ipc_create(key_t key_shm, key_t key_sem, int *shmid, int *semid,
+                    struct shm_segment **shm);
+void ipc_publish(struct shm_segment *shm);
+unsigned ipc_attach(key_t key_shm, key_t key_sem, int *shmid, int *semid);
+
+#endif
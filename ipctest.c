@@ -0,0 +1,152 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ipc.h>
+#include <sys/shm.h>
+#include <sys/sem.h>
+#include <sys/wait.h>
+
+#include "restaurant.h"
+#include "ipc.h"
+
+// Checks cook's reclaiming of IPC left under its keys (make test). A
+// segment that ipc_create has set up but not yet published, as during a
+// slow cook -R restore, belongs to a live session while its cook runs:
+// a second cook must refuse to start and leave it alone. Once that cook
+// has died the segment is stale, and the next cook removes it.
+
+#define OUTPUT "ipctest.out"
+
+static key_t key_shm, key_sem;
+static pid_t holder;
+
+static void remove_ipc(void) {
+    int shmid = shmget(key_shm, 0, 0);
+    if (shmid != -1) shmctl(shmid, IPC_RMID, NULL);
+    int semid = semget(key_sem, 0, 0);
+    if (semid != -1) semctl(semid, 0, IPC_RMID);
+}
+
+static void fail(const char *what) {
+    fprintf(stderr, "ipctest: FAIL: %s (cook output in %s)\n", what, OUTPUT);
+    if (holder > 0) kill(holder, SIGKILL);
+    remove_ipc();
+    exit(1);
+}
+
+// Start ./cook in its own process group with its output in OUTPUT
+static pid_t start_cook(void) {
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("fork");
+        exit(1);
+    } else if (pid == 0) {
+        setpgid(0, 0);
+        int fd = open(OUTPUT, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd == -1) {
+            perror(OUTPUT);
+            exit(1);
+        }
+        dup2(fd, STDOUT_FILENO);
+        dup2(fd, STDERR_FILENO);
+        execl("./cook", "./cook", "-b", (char *)NULL);
+        perror("./cook");
+        exit(1);
+    }
+    setpgid(pid, pid);
+    return pid;
+}
+
+// Wait up to two seconds for a cook to exit; a cook that took the
+// session over keeps running, and is killed
+static int wait_cook(pid_t cook, int *status) {
+    for (int i = 0; i < 200; i++) {
+        if (waitpid(cook, status, WNOHANG) == cook) return 0;
+        usleep(10000);
+    }
+    killpg(cook, SIGKILL);
+    waitpid(cook, status, 0);
+    return -1;
+}
+
+static int output_has(const char *text) {
+    char line[LOG_LINE_MAX];
+    int found = 0;
+    FILE *fp = fopen(OUTPUT, "r");
+    if (fp == NULL) return 0;
+    while (!found && fgets(line, sizeof(line), fp) != NULL) found = strstr(line, text) != NULL;
+    fclose(fp);
+    return found;
+}
+
+// The session's segment still exists and is not marked for removal
+static int segment_intact(key_t key_shm) {
+    struct shmid_ds ds;
+    int shmid = shmget(key_shm, 0, 0);
+    return shmid != -1 && shmctl(shmid, IPC_STAT, &ds) == 0 && !(ds.shm_perm.mode & SHM_DEST);
+}
+
+
+int main(void) {
+    char key[32];
+    int pipefd[2];
+
+    snprintf(key, sizeof(key), "%d", 0x53000000 + ((getpid() & 0xffff) << 4));
+    setenv("RESTAURANT_IPC_KEY", key, 1);
+    ipc_keys(&key_shm, &key_sem);
+    remove_ipc();
+
+    // A cook that has created its session and is still setting it up
+    if (pipe(pipefd) == -1) {
+        perror("pipe");
+        exit(1);
+    }
+    holder = fork();
+    if (holder < 0) {
+        perror("fork");
+        exit(1);
+    } else if (holder == 0) {
+        int shmid, semid;
+        struct shm_segment *shm;
+        ipc_create(key_shm, key_sem, &shmid, &semid, &shm);
+        if (write(pipefd[1], "", 1) != 1) exit(1);
+        pause();
+        exit(0);
+    }
+    char c;
+    if (read(pipefd[0], &c, 1) != 1) {
+        fprintf(stderr, "ipctest: holder could not create the session\n");
+        exit(1);
+    }
+
+    // A second cook must not take it over
+    int status;
+    pid_t cook = start_cook();
+    if (wait_cook(cook, &status) == -1 || !WIFEXITED(status) || WEXITSTATUS(status) != 1 ||
+        !output_has("already running")) {
+        fail("second cook did not refuse an unpublished live session");
+    }
+    if (!segment_intact(key_shm)) fail("second cook removed an unpublished live session");
+
+    // With its cook gone the session is stale and is reclaimed
+    kill(holder, SIGKILL);
+    waitpid(holder, NULL, 0);
+    holder = 0;
+    cook = start_cook();
+    int reclaimed = 0;
+    for (int i = 0; i < 200 && !reclaimed; i++) {
+        usleep(10000);
+        reclaimed = output_has("Removed stale IPC resources");
+    }
+    killpg(cook, SIGKILL);
+    waitpid(cook, NULL, 0);
+    remove_ipc();
+    if (!reclaimed) fail("cook did not reclaim a session whose cook had died");
+
+    unlink(OUTPUT);
+    printf("ipctest: ok\n");
+    return 0;
+}
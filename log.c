@@ -0,0 +1,180 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/uio.h>
+
+#include "log.h"
+#include "profile.h"
+
+// "[h:mm am]" for every minute of the session, built once per process
+static char time_table[TIME_TABLE_MINUTES][12];
+static unsigned char time_len[TIME_TABLE_MINUTES];
+static int time_table_ready;
+
+// " " followed by 0..LOG_MAX_INDENT tabs: the column each actor logs in
+static const char *const indent_table[LOG_MAX_INDENT + 1] = {
+    " ", " \t", " \t\t", " \t\t\t", " \t\t\t\t", " \t\t\t\t\t",
+    " \t\t\t\t\t\t", " \t\t\t\t\t\t\t", " \t\t\t\t\t\t\t\t",
+};
+
+static int log_mode = LOG_LINE;
+static char buf[LOG_BUF_SIZE];
+static size_t buf_used;
+static struct iovec iov[LOG_IOV_MAX];
+static int iov_used;
+static unsigned long events, writes;
+
+static int format_time(char *out, int minutes) {
+    int hour = (minutes / 60) + 11;  // Start at 11:00
+    int min = minutes % 60;
+    char am_pm = (hour < 12) ? 'a' : 'p';
+
+    if (hour > 12) hour -= 12;
+    return sprintf(out, "[%d:%02d %cm]", hour, min, am_pm);
+}
+
+static void build_time_table(void) {
+    for (int m = 0; m < TIME_TABLE_MINUTES; m++) {
+        time_len[m] = format_time(time_table[m], m);
+    }
+    time_table_ready = 1;
+}
+
+// Format minutes since 11:00am as "[h:mm am]". Strings inside the session
+// range come from the table and stay valid; anything outside it shares
+// one static buffer.
+const char *get_time_string(int minutes) {
+    static char fallback[24];
+
+    if (!time_table_ready) build_time_table();
+    if (minutes >= 0 && minutes < TIME_TABLE_MINUTES) return time_table[minutes];
+    format_time(fallback, minutes);
+    return fallback;
+}
+
+const char *indent_prefix(int level) {
+    if (level < 0) level = 0;
+    if (level > LOG_MAX_INDENT) level = LOG_MAX_INDENT;
+    return indent_table[level];
+}
+
+void log_init(int mode) {
+    static int registered;
+
+    log_mode = mode;
+    buf_used = 0;
+    iov_used = 0;
+    events = writes = 0;
+    if (!time_table_ready) build_time_table();
+    if (!registered) {
+        atexit(log_flush);
+        registered = 1;
+    }
+}
+
+void log_flush(void) {
+    struct iovec *v = iov;
+    int n = iov_used;
+
+    while (n > 0) {
+        ssize_t written = writev(STDOUT_FILENO, v, n);
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        writes++;
+        // Skip what was written; a short write leaves a partial iovec
+        while (n > 0 && (size_t)written >= v->iov_len) {
+            written -= v->iov_len;
+            v++;
+            n--;
+        }
+        if (n > 0) {
+            v->iov_base = (char *)v->iov_base + written;
+            v->iov_len -= written;
+        }
+    }
+    buf_used = 0;
+    iov_used = 0;
+}
+
+static void push(const char *base, size_t len) {
+    iov[iov_used].iov_base = (void *)base;
+    iov[iov_used].iov_len = len;
+    iov_used++;
+}
+
+// Make room for one more event of up to LOG_LINE_MAX bytes
+static void reserve(int nvec) {
+    if (iov_used + nvec > LOG_IOV_MAX || LOG_BUF_SIZE - buf_used < LOG_LINE_MAX) log_flush();
+}
+
+// Format into the buffer and queue it; longer messages are truncated.
+// An out-of-table timestamp may already have used part of the room
+// reserve() left, so the bound is whatever remains, not LOG_LINE_MAX.
+static void push_message(const char *fmt, va_list ap) {
+    size_t room = LOG_BUF_SIZE - buf_used;
+    if (room > LOG_LINE_MAX) room = LOG_LINE_MAX;
+    int len = vsnprintf(buf + buf_used, room, fmt, ap);
+    if (len < 0) len = 0;
+    if ((size_t)len >= room) len = room - 1;
+    push(buf + buf_used, len);
+    buf_used += len;
+}
+
+static void finish_event(void) {
+    events++;
+    if (log_mode == LOG_LINE) log_flush();
+}
+
+// One timestamped event: time, then prefix, then the message. Time and
+// prefix point into static tables, so only the message is formatted.
+void log_event(int minutes, const char *prefix, const char *fmt, ...) {
+    va_list ap;
+    long long start = now_ns();
+
+    reserve(3);
+    if (minutes >= 0 && minutes < TIME_TABLE_MINUTES) {
+        push(time_table[minutes], time_len[minutes]);
+    } else {
+        int len = format_time(buf + buf_used, minutes);
+        push(buf + buf_used, len);
+        buf_used += len;
+    }
+    push(prefix, strlen(prefix));
+
+    va_start(ap, fmt);
+    push_message(fmt, ap);
+    va_end(ap);
+    finish_event();
+
+    long long ns = now_ns() - start;
+    prof_record(PROF_LOG, ns);
+    if (prof_hold_start != 0) prof.log_held_ns += ns;
+    PROF_PROBE(log_event, ns);
+}
+
+// A message without a timestamp
+void log_printf(const char *fmt, ...) {
+    va_list ap;
+
+    reserve(1);
+    va_start(ap, fmt);
+    push_message(fmt, ap);
+    va_end(ap);
+    finish_event();
+}
+
+void log_stats(unsigned long *event_count, unsigned long *write_count) {
+    *event_count = events;
+    *write_count = writes;
+}
+
+void log_report(const char *name, unsigned long event_count, unsigned long write_count) {
+    log_printf("%s: log: %lu events, %lu writev calls (%.3f syscalls/event)\n", name,
+               event_count, write_count,
+               event_count ? (double)write_count / event_count : 0.0);
+}
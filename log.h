@@ -0,0 +1,26 @@
+#ifndef LOG_H
+#define LOG_H
+
+#define LOG_BUF_SIZE 65536
+#define LOG_IOV_MAX 384      // three iovecs per event
+#define LOG_LINE_MAX 512
+#define LOG_MAX_INDENT 8
+#define TIME_TABLE_MINUTES (12 * 60)  // 11:00am to 10:59pm
+
+// LOG_LINE writes every event with one writev(); LOG_BUFFERED batches
+// events in a per-process buffer until it fills, log_flush() or exit
+#define LOG_LINE 0
+#define LOG_BUFFERED 1
+
+void log_init(int mode);
+void log_event(int minutes, const char *prefix, const char *fmt, ...)
+    __attribute__((format(printf, 3, 4)));
+void log_printf(const char *fmt, ...) __attribute__((format(printf, 1, 2)));
+void log_flush(void);
+void log_stats(unsigned long *events, unsigned long *writes);
+void log_report(const char *name, unsigned long events, unsigned long writes);
+
+const char *get_time_string(int minutes);
+const char *indent_prefix(int level);
+
+#endif
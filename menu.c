@@ -0,0 +1,268 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "menu.h"
+
+// One station and one dish, so that every order is a single batch of
+// prep_minutes per person as before menus existed
+void menu_default(struct menu *menu, int prep_minutes) {
+    memset(menu, 0, sizeof(*menu));
+    menu->num_stations = 1;
+    strcpy(menu->stations[0], "kitchen");
+    menu->num_dishes = 1;
+    strcpy(menu->dishes[0].name, "meal");
+    menu->dishes[0].prep_minutes = prep_minutes;
+    menu->dishes[0].station = 0;
+}
+
+static int find_station(const struct menu *menu, const char *name) {
+    for (int i = 0; i < menu->num_stations; i++) {
+        if (strcmp(menu->stations[i], name) == 0) return i;
+    }
+    return -1;
+}
+
+// Read a menu file. Lines are "station <name>" or
+// "dish <name> <station> <prep minutes>"; # starts a comment.
+int menu_load(struct menu *menu, const char *path) {
+    FILE *fp = fopen(path, "r");
+    if (fp == NULL) {
+        perror(path);
+        return -1;
+    }
+
+    char line[256], word[NAME_LEN], name[NAME_LEN], station[NAME_LEN];
+    int minutes, lineno = 0;
+    memset(menu, 0, sizeof(*menu));
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        lineno++;
+        char *hash = strchr(line, '#');
+        if (hash != NULL) *hash = '\0';
+        if (sscanf(line, "%23s", word) != 1) continue;
+
+        if (strcmp(word, "station") == 0 && sscanf(line, "%*s %23s", name) == 1) {
+            if (find_station(menu, name) != -1 || menu->num_stations == MAX_STATIONS) {
+                fprintf(stderr, "%s:%d: duplicate station or more than %d stations\n",
+                        path, lineno, MAX_STATIONS);
+                fclose(fp);
+                return -1;
+            }
+            strcpy(menu->stations[menu->num_stations++], name);
+        } else if (strcmp(word, "dish") == 0 &&
+                   sscanf(line, "%*s %23s %23s %d", name, station, &minutes) == 3) {
+            int s = find_station(menu, station);
+            if (s == -1 || minutes < 0 || menu->num_dishes == MAX_DISHES) {
+                fprintf(stderr, "%s:%d: unknown station, bad prep time or more than %d dishes\n",
+                        path, lineno, MAX_DISHES);
+                fclose(fp);
+                return -1;
+            }
+            struct dish *dish = &menu->dishes[menu->num_dishes++];
+            strcpy(dish->name, name);
+            dish->prep_minutes = minutes;
+            dish->station = s;
+        } else {
+            fprintf(stderr, "%s:%d: expected \"station <name>\" or "
+                            "\"dish <name> <station> <minutes>\"\n", path, lineno);
+            fclose(fp);
+            return -1;
+        }
+    }
+    fclose(fp);
+
+    if (menu->num_dishes == 0) {
+        fprintf(stderr, "%s: no dishes\n", path);
+        return -1;
+    }
+    return 0;
+}
+
+static int station_dishes(const struct menu *menu, int station) {
+    int n = 0;
+    for (int i = 0; i < menu->num_dishes; i++) {
+        if (menu->dishes[i].station == station) n++;
+    }
+    return n;
+}
+
+static int station_cooks(const struct shm_segment *shm, int station) {
+    int cooks = 0;
+    for (int i = 0; i < shm->config.num_cooks; i++) {
+        if (shm->menu.cook_station[i] == station) cooks++;
+    }
+    return cooks;
+}
+
+// Give each cook a station: from a comma-separated list of station names
+// in cook order, or round robin over the stations. Every station that has
+// dishes needs a cook.
+int menu_assign(struct menu *menu, int num_cooks, const char *list) {
+    for (int i = 0; i < num_cooks; i++) {
+        menu->cook_station[i] = i % menu->num_stations;
+    }
+    if (list != NULL) {
+        char copy[256];
+        snprintf(copy, sizeof(copy), "%s", list);
+        int i = 0;
+        for (char *name = strtok(copy, ","); name != NULL; name = strtok(NULL, ",")) {
+            int s = find_station(menu, name);
+            if (s == -1 || i == num_cooks) {
+                fprintf(stderr, "Unknown station or more stations than cooks in -A: %s\n", list);
+                return -1;
+            }
+            menu->cook_station[i++] = s;
+        }
+    }
+
+    for (int s = 0; s < menu->num_stations; s++) {
+        int cooks = 0;
+        for (int i = 0; i < num_cooks; i++) {
+            if (menu->cook_station[i] == s) cooks++;
+        }
+        if (cooks == 0 && station_dishes(menu, s) > 0) {
+            fprintf(stderr, "Station %s has dishes but no cook (use -k or -A)\n",
+                    menu->stations[s]);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// Fill in a customer's order: every person takes one dish from each
+// station, the dish rotating with the customer id and the seat. The items
+// go in a slab record; returns -1 if there is no room for it.
+int order_items(struct shm_segment *shm, int customer_id, int count) {
+    const struct menu *menu = &shm->menu;
+    struct order *order = &shm->customers[customer_id].order;
+
+    int serving = 0;
+    for (int s = 0; s < menu->num_stations; s++) {
+        if (station_dishes(menu, s) > 0) serving++;
+    }
+    order->items = slab_alloc(&shm->heap, count * serving * sizeof(int));
+    if (order->items == 0) return -1;
+    int *items = slab_ptr(&shm->heap, order->items);
+    order->num_items = 0;
+    order->stations = 0;
+
+    for (int person = 0; person < count; person++) {
+        for (int s = 0; s < menu->num_stations; s++) {
+            int n = station_dishes(menu, s);
+            if (n == 0) continue;
+            int pick = (customer_id + person) % n;
+            for (int d = 0; d < menu->num_dishes; d++) {
+                if (menu->dishes[d].station == s && pick-- == 0) {
+                    items[order->num_items++] = d;
+                    break;
+                }
+            }
+            order->stations |= 1u << s;
+        }
+    }
+    order->stations_left = order->stations;
+    return 0;
+}
+
+// Release an order's items once the food is served
+void order_free(struct shm_segment *shm, int customer_id) {
+    struct order *order = &shm->customers[customer_id].order;
+    slab_free(&shm->heap, order->items);
+    order->items = 0;
+}
+
+// Minutes one cook needs for an order's dishes at a station
+int station_minutes(const struct shm_segment *shm, const struct order *order, int station) {
+    const int *items = slab_ptr(&shm->heap, order->items);
+    int minutes = 0;
+    for (int i = 0; i < order->num_items; i++) {
+        const struct dish *dish = &shm->menu.dishes[items[i]];
+        if (dish->station == station) minutes += dish->prep_minutes;
+    }
+    return minutes;
+}
+
+// "burger x2, salad": an order's dishes at a station
+void format_items(const struct shm_segment *shm, const struct order *order, int station,
+                  char *buf, size_t size) {
+    const int *items = slab_ptr(&shm->heap, order->items);
+    size_t len = 0;
+    buf[0] = '\0';
+    for (int d = 0; d < shm->menu.num_dishes; d++) {
+        if (shm->menu.dishes[d].station != station) continue;
+        int n = 0;
+        for (int i = 0; i < order->num_items; i++) {
+            if (items[i] == d) n++;
+        }
+        if (n == 0 || len >= size) continue;
+        len += snprintf(buf + len, size - len, "%s%s", len > 0 ? ", " : "", shm->menu.dishes[d].name);
+        if (n > 1 && len < size) len += snprintf(buf + len, size - len, " x%d", n);
+    }
+}
+
+// Utilisation of every station over the session so far: share of its
+// cooks' time spent preparing, and the mean wait of a batch for a cook.
+// The station with the highest figures is the bottleneck.
+void station_report(const struct shm_segment *shm) {
+    const struct menu *menu = &shm->menu;
+    for (int s = 0; s < menu->num_stations; s++) {
+        const struct cook_queue *q = &shm->stations[s];
+        int cooks = station_cooks(shm, s);
+        double capacity = (double)cooks * shm->time;
+        log_printf("Cook: Station %s: %d cook%s, %d batches, %d busy minutes, "
+                   "%.1f%% utilised, %.1f minutes mean queue wait\n",
+                   menu->stations[s], cooks, cooks == 1 ? "" : "s", q->batches, q->busy_minutes,
+                   capacity > 0 ? 100.0 * q->busy_minutes / capacity : 0.0,
+                   q->batches > 0 ? (double)q->queue_minutes / q->batches : 0.0);
+    }
+}
+
+// Weight of the newest batch in a station's moving average: 1/8
+#define BATCH_WEIGHT 8
+
+// Seed every station's batch average with a party of two ordering its
+// dishes equally, until real batches replace it
+void kitchen_init(struct shm_segment *shm) {
+    const struct menu *menu = &shm->menu;
+    for (int s = 0; s < menu->num_stations; s++) {
+        int n = station_dishes(menu, s), total = 0;
+        for (int d = 0; d < menu->num_dishes; d++) {
+            if (menu->dishes[d].station == s) total += menu->dishes[d].prep_minutes;
+        }
+        shm->stations[s].batch_minutes = n > 0 ? 2.0 * total / n : 0.0;
+    }
+}
+
+// Fold a finished batch into its station's average
+void kitchen_record(struct cook_queue *queue, int minutes) {
+    queue->batch_minutes += (minutes - queue->batch_minutes) / BATCH_WEIGHT;
+}
+
+// True if some station that every order needs is at its high-water mark
+int kitchen_full(const struct shm_segment *shm) {
+    for (int s = 0; s < shm->menu.num_stations; s++) {
+        if (station_dishes(&shm->menu, s) > 0 &&
+            QUEUED(&shm->stations[s]) >= shm->config.high_water) return 1;
+    }
+    return 0;
+}
+
+// Minutes until a party seated now with a waiter gets its food: the
+// waiter takes the orders already in its queue and then this one, and
+// every station works through its queue plus all orders not yet placed,
+// split over its cooks, before cooking this one. Read under MUTEX.
+int predict_wait(const struct shm_segment *shm, int waiter_id) {
+    int unplaced = 0;
+    for (int i = 0; i < NUM_WAITERS; i++) unplaced += QUEUED(&shm->waiters[i]);
+
+    double kitchen = 0;
+    for (int s = 0; s < shm->menu.num_stations; s++) {
+        int cooks = station_cooks(shm, s);
+        if (station_dishes(&shm->menu, s) == 0 || cooks == 0) continue;
+        const struct cook_queue *q = &shm->stations[s];
+        double minutes = q->batch_minutes * ((double)(QUEUED(q) + unplaced) / cooks + 1);
+        if (minutes > kitchen) kitchen = minutes;
+    }
+    int ordering = (QUEUED(&shm->waiters[waiter_id]) + 1) * shm->config.order_minutes;
+    return ordering + (int)(kitchen + 0.5);
+}
@@ -0,0 +1,24 @@
+#ifndef MENU_H
+#define MENU_H
+
+#include <stddef.h>
+
+#include "restaurant.h"
+
+void menu_default(struct menu *menu, int prep_minutes);
+int menu_load(struct menu *menu, const char *path);
+int menu_assign(struct menu *menu, int num_cooks, const char *list);
+
+int order_items(struct shm_segment *shm, int customer_id, int count);
+void order_free(struct shm_segment *shm, int customer_id);
+int station_minutes(const struct shm_segment *shm, const struct order *order, int station);
+void format_items(const struct shm_segment *shm, const struct order *order, int station,
+                  char *buf, size_t size);
+void station_report(const struct shm_segment *shm);
+
+void kitchen_init(struct shm_segment *shm);
+void kitchen_record(struct cook_queue *queue, int minutes);
+int kitchen_full(const struct shm_segment *shm);
+int predict_wait(const struct shm_segment *shm, int waiter_id);
+
+#endif
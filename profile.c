@@ -0,0 +1,55 @@
+#include <stdio.h>
+
+#include "profile.h"
+#include "log.h"
+
+struct prof_stats prof;
+long long prof_hold_start;
+static long long start_ns;
+
+static const char *const kind_names[PROF_KINDS] = {
+    "mutex", "held", "work", "spin", "sleep", "log"
+};
+
+// Start counting for this actor, dropping what a forked child inherited
+void prof_start(void) {
+    prof = (struct prof_stats){0};
+    prof_hold_start = 0;
+    start_ns = now_ns();
+}
+
+void prof_finish(void) {
+    prof.wall_ns = now_ns() - start_ns;
+}
+
+// Add this process's counts to a total shared with other processes
+void prof_add(struct prof_stats *total) {
+    prof_finish();
+    for (int k = 0; k < PROF_KINDS; k++) {
+        __atomic_add_fetch(&total->count[k], prof.count[k], __ATOMIC_RELAXED);
+        __atomic_add_fetch(&total->ns[k], prof.ns[k], __ATOMIC_RELAXED);
+        long long max = __atomic_load_n(&total->max_ns[k], __ATOMIC_RELAXED);
+        while (prof.max_ns[k] > max &&
+               !__atomic_compare_exchange_n(&total->max_ns[k], &max, prof.max_ns[k], 0,
+                                            __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+        }
+    }
+    __atomic_add_fetch(&total->log_held_ns, prof.log_held_ns, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&total->wall_ns, prof.wall_ns, __ATOMIC_RELAXED);
+}
+
+// Time per kind with its call count and longest interval, and the rest
+// of the wall time as other (running code, being preempted)
+void prof_report(const char *name, const struct prof_stats *stats) {
+    char line[LOG_LINE_MAX];
+    int len = 0;
+    long long other = stats->wall_ns + stats->log_held_ns;
+    for (int k = 0; k < PROF_KINDS; k++) {
+        other -= stats->ns[k];
+        len += snprintf(line + len, sizeof(line) - len, " %s=%.2f ms/%lu (max %.0f us)",
+                        kind_names[k], stats->ns[k] / 1e6, stats->count[k],
+                        stats->max_ns[k] / 1000.0);
+    }
+    log_printf("%s: profile: wall=%.1f ms%s other=%.2f ms\n", name, stats->wall_ns / 1e6,
+               line, other / 1e6);
+}
@@ -0,0 +1,54 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include "affinity.h"
+
+// Where an actor's wall time goes. Every process keeps its own counts,
+// fed from sem_wait/sem_signal, spin_wait, update_time and log_event;
+// cooks and waiters report them when they leave, customers add theirs to
+// a total in the segment. Log calls made while holding MUTEX count both
+// as held time and as log time.
+#define PROF_MUTEX 0     // waiting for MUTEX
+#define PROF_HOLD 1      // holding MUTEX
+#define PROF_WORK 2      // blocked on a work semaphore
+#define PROF_SPIN 3      // spinning for work before blocking
+#define PROF_SLEEP 4     // letting simulated minutes pass
+#define PROF_LOG 5       // formatting and writing log output
+#define PROF_KINDS 6
+
+struct prof_stats {
+    unsigned long count[PROF_KINDS];
+    long long ns[PROF_KINDS];
+    long long max_ns[PROF_KINDS];
+    long long log_held_ns;      // part of the log time spent holding MUTEX
+    long long wall_ns;
+};
+
+extern struct prof_stats prof;
+extern long long prof_hold_start;   // 0 when MUTEX is not held
+
+// Static probe points for perf and bpftrace (usdt:<binary>:restaurant:<name>)
+// when the build found <sys/sdt.h>; each passes the interval in ns
+#ifdef HAVE_SDT
+#include <sys/sdt.h>
+#define PROF_PROBE(name, ns) DTRACE_PROBE1(restaurant, name, ns)
+#else
+#define PROF_PROBE(name, ns) ((void)0)
+#endif
+
+static inline void prof_record(int kind, long long ns) {
+    prof.count[kind]++;
+    prof.ns[kind] += ns;
+    if (ns > prof.max_ns[kind]) prof.max_ns[kind] = ns;
+}
+
+// Record an interval that started at start and fire its probe
+#define PROF(probe, kind, start) \
+    do { long long ns_ = now_ns() - (start); prof_record(kind, ns_); PROF_PROBE(probe, ns_); } while (0)
+
+void prof_start(void);
+void prof_finish(void);
+void prof_add(struct prof_stats *total);
+void prof_report(const char *name, const struct prof_stats *stats);
+
+#endif
@@ -0,0 +1,137 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <unistd.h>
+#include <sched.h>
+
+#include "restaurant.h"
+#include "detsched.h"
+
+// Let minutes of simulated time pass, then move the shared clock forward
+// unless someone else has already moved it further
+void update_time(struct shm_segment *shm, int semid, int minutes) {
+    int curr_time = shm->time;
+    long long start = now_ns();
+    if (det != NULL) det_sleep(minutes);
+    else usleep(minutes * shm->config.scale);
+    PROF(sleep, PROF_SLEEP, start);
+    advance_time(shm, semid, curr_time + minutes);
+}
+
+void advance_time(struct shm_segment *shm, int semid, int time) {
+    sem_wait(semid, MUTEX);
+    if (observe_time(shm) < time) {
+        shm->time = time;
+    }
+    sem_signal(semid, MUTEX);
+}
+
+// Count a broken session invariant and report it on stderr
+void invariant_failed(struct shm_segment *shm, const char *fmt, ...) {
+    va_list ap;
+    __atomic_add_fetch(&shm->violations, 1, __ATOMIC_RELAXED);
+    fprintf(stderr, "Invariant violated: ");
+    va_start(ap, fmt);
+    vfprintf(stderr, fmt, ap);
+    va_end(ap);
+    fputc('\n', stderr);
+}
+
+static int last_seen_time;
+
+// Read the clock under MUTEX, checking that this process never sees it go
+// backwards
+int observe_time(struct shm_segment *shm) {
+    int now = shm->time;
+    if (now < last_seen_time) {
+        invariant_failed(shm, "clock went back from %d to %d", last_seen_time, now);
+    }
+    last_seen_time = now;
+    return now;
+}
+
+int perturb_permille;
+static unsigned perturb_state;
+static int perturb_max_us;
+
+// Seed this actor's perturbation from the session's seed. Deterministic
+// sessions are never perturbed: their schedule is the seed's.
+void perturb_init(const struct session_config *config, int actor) {
+    perturb_permille = det != NULL ? 0 : config->perturb;
+    perturb_state = (config->perturb_seed + 1) * 2654435761u ^ (actor + 1) * 40503u;
+    if (perturb_state == 0) perturb_state = 1;
+    perturb_max_us = config->scale / 4;
+}
+
+void perturb_point(void) {
+    // xorshift32
+    unsigned x = perturb_state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    perturb_state = x;
+    if (x % 1000 >= (unsigned)perturb_permille) return;
+    if (x & 0x80000000u) sched_yield();
+    else usleep((x >> 10) % (perturb_max_us + 1));
+}
+
+void config_defaults(struct session_config *config) {
+    config->scale = SCALE_FACTOR;
+    config->num_cooks = NUM_COOKS;
+    config->num_tables = NUM_TABLES;
+    config->cook_minutes = COOK_MINUTES;
+    config->order_minutes = ORDER_MINUTES;
+    config->eat_minutes = EAT_MINUTES;
+    config->closing_time = CLOSING_TIME;
+    config->high_water = HIGH_WATER;
+    config->max_wait = MAX_WAIT;
+    config->perturb = PERTURB;
+    config->perturb_seed = 0;
+}
+
+static int parse_range(const char *arg, int min, int max, int *value) {
+    char *end;
+    long v = strtol(arg, &end, 10);
+    if (*arg == '\0' || *end != '\0' || v < min || v > max) return -1;
+    *value = v;
+    return 0;
+}
+
+// Parse a numeric option's value within [min, max], reporting a bad one
+int parse_int_option(int opt, const char *arg, int min, int max, int *value) {
+    if (parse_range(arg, min, max, value) == -1) {
+        fprintf(stderr, "Invalid value for -%c: %s\n", opt, arg);
+        return -1;
+    }
+    return 0;
+}
+
+// Handle one of cook's session options (-u -k -t -p -o -e -z -H -W -y -Y). Returns -1
+// for an unknown option or a value out of range.
+int parse_config_option(int opt, const char *arg, struct session_config *config) {
+    int r = -1;
+    switch (opt) {
+        case 'u': r = parse_range(arg, 1, 10000000, &config->scale); break;
+        case 'k': r = parse_range(arg, 1, MAX_COOKS, &config->num_cooks); break;
+        // Every party at a table may have an order in flight, and a
+        // restored session queues them all at once
+        case 't': r = parse_range(arg, 1, COOK_QUEUE_SIZE - 1, &config->num_tables); break;
+        case 'p': r = parse_range(arg, 0, 60, &config->cook_minutes); break;
+        case 'o': r = parse_range(arg, 0, 60, &config->order_minutes); break;
+        case 'e': r = parse_range(arg, 0, 240, &config->eat_minutes); break;
+        case 'z': r = parse_range(arg, 1, 720, &config->closing_time); break;
+        // Every waiter may pass the mark at once, so leave a slot for each
+        case 'H': r = parse_range(arg, 1, HIGH_WATER, &config->high_water); break;
+        case 'W': r = parse_range(arg, 0, 720, &config->max_wait); break;
+        case 'y': r = parse_range(arg, 0, 1000, &config->perturb); break;
+        case 'Y': {
+            int seed;
+            r = parse_range(arg, 0, 0x7fffffff, &seed);
+            if (r == 0) config->perturb_seed = seed;
+            break;
+        }
+        default: return -1;
+    }
+    if (r == -1) fprintf(stderr, "Invalid value for -%c: %s\n", opt, arg);
+    return r;
+}
@@ -0,0 +1,390 @@
+#ifndef RESTAURANT_H
+#define RESTAURANT_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <sys/types.h>
+#include <sys/ipc.h>
+#include <sys/sem.h>
+
+#include "spinwait.h"
+#include "affinity.h"
+#include "log.h"
+#include "slab.h"
+#include "profile.h"
+
+// Constants
+#define CACHE_LINE_SIZE 64
+#define MAX_COOKS 8
+#define NUM_WAITERS 5
+#define MAX_CUSTOMERS 4096    // customer ids, each with a record and a semaphore
+#define WAITER_QUEUE_SIZE 100
+#define COOK_QUEUE_SIZE 200
+#define MAX_STATIONS 8
+#define MAX_DISHES 32
+#define NAME_LEN 24
+
+#define SHM_MAGIC 0x52535431  // "RST1"
+#define SHM_VERSION 11
+
+// Default session parameters, each of which cook can override
+#define SCALE_FACTOR 100000  // 100ms = 100,000 microseconds per minute
+#define NUM_COOKS 2
+#define NUM_TABLES 10
+#define COOK_MINUTES 5       // per person
+#define ORDER_MINUTES 1
+#define EAT_MINUTES 30
+#define CLOSING_TIME 240     // 3:00pm
+#define HIGH_WATER (COOK_QUEUE_SIZE - NUM_WAITERS)  // station queue limit
+#define MAX_WAIT 0           // predicted wait a party accepts, 0 = any
+#define PERTURB 0            // per mille of sync points that yield or stall
+
+// Semaphore indexes
+#define MUTEX 0
+#define WAITER_U_SEM 1
+#define WAITER_V_SEM 2
+#define WAITER_W_SEM 3
+#define WAITER_X_SEM 4
+#define WAITER_Y_SEM 5
+#define STATION_BASE_SEM 6   // one per cook station
+#define CUSTOMER_BASE_SEM (STATION_BASE_SEM + MAX_STATIONS)
+#define ENGINE_SEM (CUSTOMER_BASE_SEM + MAX_CUSTOMERS)   // customer -a event loop
+#define DET_BASE_SEM (ENGINE_SEM + 1)   // one per actor
+#define NUM_SEMS (DET_BASE_SEM + DET_MAX_ACTORS)
+
+// Actors of the deterministic scheduler: cooks, waiters, the customer
+// parent and the customers (by customer id)
+#define DET_COOK(id) (id)
+#define DET_WAITER(id) (MAX_COOKS + (id))
+#define DET_PARENT (MAX_COOKS + NUM_WAITERS)
+#define DET_CUSTOMER(id) (DET_PARENT + (id))
+#define DET_MAX_ACTORS (DET_PARENT + MAX_CUSTOMERS)
+
+// Start a new cache line. Fields written by different processes are kept
+// on separate lines so that one writer does not invalidate another's line.
+#define CACHE_ALIGNED _Alignas(CACHE_LINE_SIZE)
+
+// Session header. magic is written last by cook once everything else is
+// initialized; the owner pids let a new cook tell a stale segment from a
+// live one, and generation increases each time a stale one is replaced.
+struct shm_header {
+    unsigned magic;
+    unsigned version;
+    unsigned generation;
+    pid_t cook_pid;
+    pid_t waiter_pid;
+    pid_t customer_pid;
+    pid_t staff_pids[MAX_COOKS + NUM_WAITERS];
+};
+
+// Session parameters, set by cook before the segment is published and
+// only read afterwards
+struct session_config {
+    int scale;            // microseconds of real time per simulated minute
+    int num_cooks;
+    int num_tables;
+    int cook_minutes;     // per person
+    int order_minutes;
+    int eat_minutes;
+    int closing_time;     // minutes after 11:00am
+    int high_water;       // orders queued at a station before waiters hold back
+    int max_wait;         // parties leave if the predicted wait is longer
+    int perturb;          // stress: per mille of sync points that yield or stall
+    unsigned perturb_seed;
+};
+
+// Waiters stop taking orders while a station's queue is at the high-water
+// mark and resume once it is down to the low-water mark
+#define LOW_WATER(config) ((config)->high_water / 2)
+
+// A seated party waiting for its waiter, queued by the customer
+struct seat_request {
+    int customer_id;
+    int count;
+};
+
+// The rings below count entries put in at back and taken out at front
+// and index them modulo their size, so the number queued is back - front
+// and no count is written from both ends. Each line has a single writer.
+#define QUEUED(q) ((q)->back - (q)->front)
+
+// Per-waiter queue of seat_request handles. Customers produce at back, the
+// waiter consumes at front, and cooks post finished orders to a second ring
+// of customer ids. A waiter that leaves a customer waiting because the
+// kitchen is full counts the wakeup it consumed in deferred; cooks count
+// the ones they repost in released.
+struct waiter_queue {
+    CACHE_ALIGNED int back;               // written by customers
+    CACHE_ALIGNED int front;              // written by the waiter
+    int ready_front;
+    int orders_out;                       // orders at the cooks, not yet served
+    int deferred;
+    CACHE_ALIGNED int ready_back;         // written by cooks
+    int released;
+    CACHE_ALIGNED long long wake_ns;      // when the waiter was last signalled
+    unsigned seq;                         // bumped on every signal
+    CACHE_ALIGNED slab_ref entries[WAITER_QUEUE_SIZE];
+    int ready_ids[WAITER_QUEUE_SIZE];
+};
+
+#define READY(wq) ((wq)->ready_back - (wq)->ready_front)      // cooked, not served
+#define DEFERRED(wq) ((wq)->deferred - (wq)->released)        // wakeups held back
+
+// Menu, loaded by cook before the segment is published. Every dish is
+// prepared at one station and each cook works at one station.
+struct dish {
+    char name[NAME_LEN];
+    int prep_minutes;
+    int station;
+};
+
+struct menu {
+    int num_stations;
+    int num_dishes;
+    char stations[MAX_STATIONS][NAME_LEN];
+    struct dish dishes[MAX_DISHES];
+    int cook_station[MAX_COOKS];
+};
+
+// One station's share of an order: the order's dishes for that station,
+// cooked together by one cook
+struct cook_order {
+    int waiter_id;
+    int customer_id;
+    int customer_cnt;
+    int queued_at;        // minute the waiter placed it
+};
+
+// Cook queue of one station, holding cook_order handles. Waiters produce
+// at back, the station's cooks consume at front.
+struct cook_queue {
+    CACHE_ALIGNED int back;               // written by waiters
+    CACHE_ALIGNED int front;              // written by cooks
+    int batches;                          // prepared so far
+    int busy_minutes;                     // spent preparing them
+    int queue_minutes;                    // spent waiting for a cook
+    double batch_minutes;                 // moving average of a batch
+    CACHE_ALIGNED long long wake_ns;      // when a cook was last signalled
+    unsigned seq;                         // bumped on every signal
+    CACHE_ALIGNED slab_ref orders[COOK_QUEUE_SIZE];
+};
+
+// Where a customer is in the meal. Kept in shared memory so that a
+// restored snapshot can bring in-flight parties back.
+#define CUST_NONE 0
+#define CUST_SEATED 1     // waiting for (or talking to) a waiter
+#define CUST_ORDERED 2    // order in the cook queue or being cooked
+#define CUST_COOKED 3     // food ready, waiting to be served
+#define CUST_SERVED 4     // eating
+#define CUST_LEFT 5
+#define CUST_NO_TABLE 6   // turned away: restaurant full
+#define CUST_LATE 7       // turned away: arrived after closing
+#define CUST_TOO_BUSY 8   // left: predicted wait over the limit
+
+#define CUST_IN_RESTAURANT(state) ((state) >= CUST_SEATED && (state) < CUST_LEFT)
+
+// Items of an order: num_items dish numbers in a slab record
+struct order {
+    slab_ref items;
+    int num_items;
+    unsigned stations;        // bit per station with items
+    unsigned stations_left;   // not prepared yet
+};
+
+struct customer_record {
+    int state;
+    int arrival_time;
+    int count;
+    int waiter_id;
+    int order_seq;        // position in the cook queue's arrival order
+    int served_at;
+    int predicted;        // wait predicted on arrival
+    unsigned notify;      // waiter notifications, when customers run in one process
+    int times_served;     // by its waiter; exactly once for a party that dined
+    int resume_state;     // state when the session was restored
+    struct order order;
+};
+
+// Per-staff counters, one cache line per cook or waiter
+struct staff_stats {
+    CACHE_ALIGNED struct spin_stats spin;
+};
+
+// Deterministic mode. Exactly one actor runs at a time: the one holding
+// the baton, which it passes on only when it blocks, sleeps or exits.
+// Semaphores other than MUTEX are counted here instead of in the kernel and
+// sleeps advance a virtual clock. The next actor is the runnable one that
+// became runnable first, else the sleeper with the earliest wakeup, ties
+// going by a priority derived from the seed and then by actor number.
+#define DET_IDLE 0
+#define DET_RUNNABLE 1
+#define DET_RUNNING 2
+#define DET_BLOCKED 3
+#define DET_SLEEPING 4
+#define DET_DONE 5
+
+// Virtual semaphores past the real set, posted when every actor of a
+// class has exited
+#define DET_STAFF 0
+#define DET_CUSTOMERS 1
+#define DET_DONE_SEM(cls) (NUM_SEMS + (cls))
+
+struct det_actor {
+    int state;
+    int semnum;           // blocked on
+    int wake;             // sleeping until this minute
+    unsigned priority;
+    unsigned long seq;    // order in which it blocked or became runnable
+};
+
+struct det_state {
+    int enabled;
+    unsigned seed;
+    int started;          // customer parent took the first baton
+    int registered;       // staff ready before the start
+    int running;
+    int now;              // virtual minutes since 11:00am
+    int live[2];          // staff and customers not yet exited
+    unsigned long next_seq;
+    unsigned long switches;
+    int counts[NUM_SEMS + 2];
+    struct det_actor actors[DET_MAX_ACTORS];
+};
+
+#define COOK_STATS(id) (id)
+#define WAITER_STATS(id) (MAX_COOKS + (id))
+
+// Layout of the shared memory segment. Every hot session field lives on
+// its own cache line.
+struct shm_segment {
+    CACHE_ALIGNED struct shm_header header;
+    struct session_config config;
+    struct menu menu;
+    CACHE_ALIGNED int time;               // minutes since 11:00am
+    CACHE_ALIGNED int empty_tables;
+    CACHE_ALIGNED int next_waiter;
+    CACHE_ALIGNED int end_session;
+    struct waiter_queue waiters[NUM_WAITERS];
+    struct cook_queue stations[MAX_STATIONS];
+    struct staff_stats staff[MAX_COOKS + NUM_WAITERS];
+    CACHE_ALIGNED int last_customer;      // highest customer id that arrived
+    int order_seq;
+    int deferrals;                        // times a waiter held back an order
+    int violations;                       // broken session invariants
+    int restored;                         // session was resumed from a snapshot
+    int engine;                           // customers run as coroutines (customer -a)
+    struct customer_record customers[MAX_CUSTOMERS];
+    CACHE_ALIGNED struct slab_heap heap;  // queue entries and order items
+    CACHE_ALIGNED struct det_state det;
+    CACHE_ALIGNED unsigned long log_events;  // totals over all customers
+    unsigned long log_writes;
+    CACHE_ALIGNED struct prof_stats customer_prof;  // totals over all customers
+};
+
+#define SHM_SIZE sizeof(struct shm_segment)
+
+// Semaphore operations
+union semun {
+    int val;
+    struct semid_ds *buf;
+    unsigned short *array;
+};
+
+// Set in every process of a deterministic session, NULL otherwise
+extern struct det_state *det;
+void det_wait(int semnum);
+void det_signal(int semnum);
+
+// Stress mode: a seeded share of semaphore operations first yields the
+// CPU or stalls briefly, to shake out orderings that rarely happen
+extern int perturb_permille;
+void perturb_point(void);
+
+static inline void perturb(void) {
+    if (perturb_permille > 0) perturb_point();
+}
+
+// Both time the wait or the hold for the profile (profile.h)
+static inline void sem_wait(int semid, int semnum) {
+    long long start = now_ns();
+    if (det != NULL && semnum != MUTEX) {
+        det_wait(semnum);
+        PROF(work_wait, PROF_WORK, start);
+        return;
+    }
+    // MUTEX is taken with SEM_UNDO so the kernel releases it if we die
+    struct sembuf sb = {semnum, -1, semnum == MUTEX ? SEM_UNDO : 0};
+    perturb();
+    if (semop(semid, &sb, 1) == -1) {
+        perror("semop wait");
+        exit(1);
+    }
+    if (semnum == MUTEX) {
+        PROF(mutex_wait, PROF_MUTEX, start);
+        prof_hold_start = now_ns();
+    } else {
+        PROF(work_wait, PROF_WORK, start);
+    }
+}
+
+static inline void sem_signal(int semid, int semnum) {
+    if (semnum == MUTEX && prof_hold_start != 0) {
+        PROF(mutex_held, PROF_HOLD, prof_hold_start);
+        prof_hold_start = 0;
+    }
+    if (det != NULL && semnum != MUTEX) {
+        det_signal(semnum);
+        return;
+    }
+    struct sembuf sb = {semnum, 1, semnum == MUTEX ? SEM_UNDO : 0};
+    if (semop(semid, &sb, 1) == -1) {
+        perror("semop signal");
+        exit(1);
+    }
+    perturb();
+}
+
+// Wake a waiter or a cook, stamping the wakeup for latency accounting and
+// publishing it to spinning waits
+static inline void wake_waiter(struct shm_segment *shm, int semid, int waiter_id) {
+    stamp_wake(&shm->waiters[waiter_id].wake_ns);
+    spin_signal(&shm->waiters[waiter_id].seq, semid, WAITER_U_SEM + waiter_id);
+}
+
+static inline void wake_cook(struct shm_segment *shm, int semid, int station) {
+    stamp_wake(&shm->stations[station].wake_ns);
+    spin_signal(&shm->stations[station].seq, semid, STATION_BASE_SEM + station);
+}
+
+// Tell a customer that its order was placed or its food served: on its
+// own semaphore, or through its counter and the event loop's semaphore
+// when one process runs all the customers
+static inline void notify_customer(struct shm_segment *shm, int semid, int customer_id) {
+    if (shm->engine) {
+        __atomic_add_fetch(&shm->customers[customer_id].notify, 1, __ATOMIC_RELEASE);
+        sem_signal(semid, ENGINE_SEM);
+    } else {
+        sem_signal(semid, CUSTOMER_BASE_SEM + customer_id);
+    }
+}
+
+void update_time(struct shm_segment *shm, int semid, int minutes);
+void advance_time(struct shm_segment *shm, int semid, int time);
+int observe_time(struct shm_segment *shm);
+void invariant_failed(struct shm_segment *shm, const char *fmt, ...)
+    __attribute__((format(printf, 2, 3)));
+void perturb_init(const struct session_config *config, int actor);
+
+void config_defaults(struct session_config *config);
+int parse_config_option(int opt, const char *arg, struct session_config *config);
+int parse_int_option(int opt, const char *arg, int min, int max, int *value);
+
+_Static_assert(offsetof(struct waiter_queue, front) % CACHE_LINE_SIZE == 0,
+               "waiter front must start a cache line");
+_Static_assert(sizeof(struct waiter_queue) % CACHE_LINE_SIZE == 0,
+               "waiter queues must not share cache lines");
+_Static_assert(offsetof(struct shm_segment, waiters) % CACHE_LINE_SIZE == 0,
+               "waiter queues must start a cache line");
+
+#endif
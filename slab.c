@@ -0,0 +1,137 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "slab.h"
+#include "affinity.h"
+#include "log.h"
+
+#define TAG_SHIFT 32
+#define REF_MASK 0xffffffffULL
+
+static int size_class(size_t size) {
+    int cls = 0;
+    while ((size_t)(SLAB_MIN_SIZE << cls) < size) cls++;
+    return cls;
+}
+
+static inline slab_ref *next_link(struct slab_heap *heap, slab_ref ref) {
+    return (slab_ref *)slab_ptr(heap, ref);
+}
+
+void slab_init(struct slab_heap *heap) {
+    memset(heap->classes, 0, sizeof(heap->classes));
+    memset(heap->page_class, 0, sizeof(heap->page_class));
+    heap->next_page = 1;
+}
+
+// Push the chain first..last (already linked) onto a class's free list
+static void push_chain(struct slab_heap *heap, struct slab_class *c, slab_ref first, slab_ref last) {
+    unsigned long long old = __atomic_load_n(&c->head, __ATOMIC_ACQUIRE), new;
+    do {
+        *next_link(heap, last) = (slab_ref)(old & REF_MASK);
+        new = ((old >> TAG_SHIFT) + 1) << TAG_SHIFT | first;
+    } while (!__atomic_compare_exchange_n(&c->head, &old, new, 1, __ATOMIC_RELEASE,
+                                          __ATOMIC_ACQUIRE));
+}
+
+static slab_ref pop(struct slab_heap *heap, struct slab_class *c) {
+    unsigned long long old = __atomic_load_n(&c->head, __ATOMIC_ACQUIRE), new;
+    slab_ref ref;
+    do {
+        ref = (slab_ref)(old & REF_MASK);
+        if (ref == 0) return 0;
+        // The object may be popped by someone else meanwhile; its link is
+        // then stale, but the tag makes the exchange below fail
+        slab_ref next = __atomic_load_n(next_link(heap, ref), __ATOMIC_RELAXED);
+        new = ((old >> TAG_SHIFT) + 1) << TAG_SHIFT | next;
+    } while (!__atomic_compare_exchange_n(&c->head, &old, new, 1, __ATOMIC_ACQUIRE,
+                                          __ATOMIC_ACQUIRE));
+    return ref;
+}
+
+// Take a fresh page for a class, keep its first object and put the rest on
+// the free list. Returns 0 if the heap is used up.
+static slab_ref carve_page(struct slab_heap *heap, int cls) {
+    unsigned page = __atomic_fetch_add(&heap->next_page, 1, __ATOMIC_RELAXED);
+    if (page >= SLAB_PAGES) return 0;
+    heap->page_class[page] = cls;
+    __atomic_add_fetch(&heap->classes[cls].pages, 1, __ATOMIC_RELAXED);
+
+    size_t size = SLAB_MIN_SIZE << cls;
+    slab_ref base = page * SLAB_PAGE_SIZE;
+    int count = SLAB_PAGE_SIZE / size;
+    for (int i = 1; i < count - 1; i++) {
+        *next_link(heap, base + i * size) = base + (i + 1) * size;
+    }
+    if (count > 1) push_chain(heap, &heap->classes[cls], base + size, base + (count - 1) * size);
+    return base;
+}
+
+// A zeroed record of at least size bytes, or 0 if none is left
+slab_ref slab_alloc(struct slab_heap *heap, size_t size) {
+    long long start = now_ns();
+    int cls = size_class(size);
+    if (cls >= SLAB_CLASSES) return 0;
+    struct slab_class *c = &heap->classes[cls];
+
+    slab_ref ref = pop(heap, c);
+    if (ref == 0) ref = carve_page(heap, cls);
+    if (ref == 0) {
+        __atomic_add_fetch(&c->failures, 1, __ATOMIC_RELAXED);
+        return 0;
+    }
+    memset(slab_ptr(heap, ref), 0, SLAB_MIN_SIZE << cls);
+    unsigned long live = __atomic_add_fetch(&c->allocs, 1, __ATOMIC_RELAXED) -
+                         __atomic_load_n(&c->frees, __ATOMIC_RELAXED);
+    unsigned long peak = __atomic_load_n(&c->peak, __ATOMIC_RELAXED);
+    while (live > peak && !__atomic_compare_exchange_n(&c->peak, &peak, live, 1,
+                                                       __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    }
+    __atomic_add_fetch(&c->requested, size, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&c->ns, now_ns() - start, __ATOMIC_RELAXED);
+    return ref;
+}
+
+void slab_free(struct slab_heap *heap, slab_ref ref) {
+    if (ref == 0) return;
+    long long start = now_ns();
+    struct slab_class *c = &heap->classes[heap->page_class[ref / SLAB_PAGE_SIZE]];
+    push_chain(heap, c, ref, ref);
+    __atomic_add_fetch(&c->frees, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&c->ns, now_ns() - start, __ATOMIC_RELAXED);
+}
+
+// Per-class traffic and peak use, and how much space the allocator
+// wastes: internal fragmentation is the slack between the sizes asked for
+// and the class sizes over all allocations, external is the carved space
+// that was free even at each class's peak. Timings are left out when they
+// would make the output vary between runs (timed 0).
+void slab_report(const char *name, const struct slab_heap *heap, int timed) {
+    unsigned long given = 0, requested = 0, carved = 0, peak_bytes = 0, ops = 0;
+    long long ns = 0;
+
+    for (int cls = 0; cls < SLAB_CLASSES; cls++) {
+        const struct slab_class *c = &heap->classes[cls];
+        size_t size = SLAB_MIN_SIZE << cls;
+        if (c->pages == 0) continue;
+        log_printf("%s: slab %zuB: %u pages, %lu allocs, %lu frees, %lu live, %lu peak, %lu failed\n",
+                   name, size, c->pages, c->allocs, c->frees, c->allocs - c->frees, c->peak,
+                   c->failures);
+        given += c->allocs * size;
+        requested += c->requested;
+        carved += (unsigned long)c->pages * (SLAB_PAGE_SIZE / size) * size;
+        peak_bytes += c->peak * size;
+        ops += c->allocs + c->frees;
+        ns += c->ns;
+    }
+
+    unsigned used = heap->next_page > SLAB_PAGES ? SLAB_PAGES : heap->next_page;
+    log_printf("%s: slab heap: %u of %d pages carved, fragmentation %.1f%% internal, "
+               "%.1f%% external at peak\n", name, used - 1, SLAB_PAGES - 1,
+               given > 0 ? 100.0 * (given - requested) / given : 0.0,
+               carved > 0 ? 100.0 * (carved - peak_bytes) / carved : 0.0);
+    if (timed && ops > 0) {
+        log_printf("%s: slab heap: %lu alloc/free calls, %.0f ns each, %.1f M calls/s\n",
+                   name, ops, (double)ns / ops, ns > 0 ? ops * 1000.0 / ns : 0.0);
+    }
+}
@@ -0,0 +1,50 @@
+#ifndef SLAB_H
+#define SLAB_H
+
+#include <stddef.h>
+
+// Slab allocator inside the shared segment. Records are named by their
+// byte offset into the heap (a slab_ref), which means the same thing in
+// every process whatever address the segment is attached at; 0 is no
+// record. Each size class carves 4 KB pages into equal objects and keeps
+// the free ones on a lock-free stack, so allocation and free need no
+// semaphore.
+#define SLAB_PAGE_SIZE 4096
+#define SLAB_PAGES 64          // page 0 is never used, so offset 0 is free for "none"
+#define SLAB_CLASSES 5         // 16, 32, 64, 128 and 256 bytes
+#define SLAB_MIN_SIZE 16
+#define SLAB_MAX_SIZE (SLAB_MIN_SIZE << (SLAB_CLASSES - 1))
+
+typedef unsigned slab_ref;
+
+// Per-class free list and counters. head packs a modification tag above
+// the offset of the top free object so that a compare-and-swap cannot be
+// fooled by an object popped and pushed back in between (ABA).
+struct slab_class {
+    _Alignas(64) unsigned long long head;
+    unsigned pages;
+    unsigned long allocs;
+    unsigned long frees;
+    unsigned long failures;
+    unsigned long requested;   // bytes asked for over all allocations
+    unsigned long peak;        // most objects live at once
+    long long ns;              // time spent in alloc and free
+};
+
+struct slab_heap {
+    struct slab_class classes[SLAB_CLASSES];
+    _Alignas(64) unsigned next_page;
+    unsigned char page_class[SLAB_PAGES];
+    _Alignas(64) char mem[SLAB_PAGES * SLAB_PAGE_SIZE];
+};
+
+static inline void *slab_ptr(const struct slab_heap *heap, slab_ref ref) {
+    return (void *)(heap->mem + ref);
+}
+
+void slab_init(struct slab_heap *heap);
+slab_ref slab_alloc(struct slab_heap *heap, size_t size);
+void slab_free(struct slab_heap *heap, slab_ref ref);
+void slab_report(const char *name, const struct slab_heap *heap, int timed);
+
+#endif
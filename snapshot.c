@@ -0,0 +1,204 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/ipc.h>
+#include <sys/sem.h>
+
+#include "snapshot.h"
+
+// Copy the segment while holding MUTEX. Every actor changes shared state
+// only inside MUTEX, so the copy is consistent; the actors are paused just
+// for the memcpy and the file is written after the lock is dropped.
+int snapshot_save(struct shm_segment *shm, int semid, const char *path, long long *pause_ns) {
+    struct snapshot_header hdr = {SNAPSHOT_MAGIC, SNAPSHOT_VERSION, SHM_VERSION, SHM_SIZE};
+    struct shm_segment *copy = malloc(SHM_SIZE);
+    if (copy == NULL) {
+        perror("malloc");
+        return -1;
+    }
+
+    long long start = now_ns();
+    sem_wait(semid, MUTEX);
+    memcpy(copy, shm, SHM_SIZE);
+    sem_signal(semid, MUTEX);
+    *pause_ns = now_ns() - start;
+
+    hdr.generation = copy->header.generation;
+    hdr.time = copy->time;
+
+    // Write to a temporary file and rename it, so a crash while writing
+    // never replaces a good snapshot with a torn one
+    char tmp[4096];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    FILE *fp = fopen(tmp, "wb");
+    if (fp == NULL) {
+        perror("fopen");
+        free(copy);
+        return -1;
+    }
+    int ok = fwrite(&hdr, sizeof(hdr), 1, fp) == 1 && fwrite(copy, SHM_SIZE, 1, fp) == 1 &&
+             fflush(fp) == 0 && fsync(fileno(fp)) == 0;
+    ok = (fclose(fp) == 0) && ok;
+    free(copy);
+    if (!ok || rename(tmp, path) == -1) {
+        perror("snapshot write");
+        unlink(tmp);
+        return -1;
+    }
+    return 0;
+}
+
+// Start the slab heap afresh, keeping only the item lists of orders that
+// are still being cooked or served. Queue entries are made again below.
+static int rebuild_heap(struct shm_segment *shm) {
+    static char saved[MAX_CUSTOMERS][SLAB_MAX_SIZE];
+    for (int id = 1; id < MAX_CUSTOMERS; id++) {
+        struct customer_record *rec = &shm->customers[id];
+        if (rec->state != CUST_ORDERED && rec->state != CUST_COOKED) rec->order.items = 0;
+        if (rec->order.items != 0) {
+            memcpy(saved[id], slab_ptr(&shm->heap, rec->order.items),
+                   rec->order.num_items * sizeof(int));
+        }
+    }
+
+    slab_init(&shm->heap);
+    for (int id = 1; id < MAX_CUSTOMERS; id++) {
+        struct order *order = &shm->customers[id].order;
+        if (order->items == 0) continue;
+        order->items = slab_alloc(&shm->heap, order->num_items * sizeof(int));
+        if (order->items == 0) return -1;
+        memcpy(slab_ptr(&shm->heap, order->items), saved[id], order->num_items * sizeof(int));
+    }
+    return 0;
+}
+
+// Put the in-flight work recorded in the customer table back into the
+// waiter and cook queues. Only customer records are trusted; queue indices
+// are rebuilt because a snapshot can fall between a waiter or cook taking
+// an entry off a queue and finishing with it.
+static int rebuild_queues(struct shm_segment *shm) {
+    int order_ids[MAX_CUSTOMERS];
+    int num_orders = 0;
+    int seated = 0;
+
+    if (rebuild_heap(shm) == -1) return -1;
+
+    memset(shm->waiters, 0, sizeof(shm->waiters));
+    for (int s = 0; s < MAX_STATIONS; s++) {
+        // Keep the utilisation counts, empty the ring
+        shm->stations[s].back = shm->stations[s].front = 0;
+    }
+    shm->end_session = 0;
+
+    for (int id = 1; id < MAX_CUSTOMERS; id++) {
+        struct customer_record *rec = &shm->customers[id];
+        struct waiter_queue *wq = &shm->waiters[rec->waiter_id];
+
+        if (!CUST_IN_RESTAURANT(rec->state)) continue;
+        seated++;
+
+        if (rec->state == CUST_SEATED) {
+            slab_ref ref = slab_alloc(&shm->heap, sizeof(struct seat_request));
+            if (ref == 0) return -1;
+            struct seat_request *request = slab_ptr(&shm->heap, ref);
+            request->customer_id = id;
+            request->count = rec->count;
+            wq->entries[wq->back++] = ref;
+        } else if (rec->state == CUST_COOKED) {
+            wq->ready_ids[wq->ready_back++] = id;
+        }
+        if (rec->state == CUST_ORDERED) {
+            order_ids[num_orders++] = id;
+        }
+        if (rec->state == CUST_ORDERED || rec->state == CUST_COOKED) {
+            wq->orders_out++;
+        }
+        rec->resume_state = rec->state;
+    }
+
+    // Orders go back in the order they were first queued
+    for (int i = 1; i < num_orders; i++) {
+        int id = order_ids[i], j = i;
+        while (j > 0 && shm->customers[order_ids[j - 1]].order_seq > shm->customers[id].order_seq) {
+            order_ids[j] = order_ids[j - 1];
+            j--;
+        }
+        order_ids[j] = id;
+    }
+    // Each goes to the stations that had not finished their part; a part
+    // that was being prepared is prepared again
+    for (int i = 0; i < num_orders; i++) {
+        struct customer_record *rec = &shm->customers[order_ids[i]];
+        for (int s = 0; s < shm->menu.num_stations; s++) {
+            if (!(rec->order.stations_left & (1u << s))) continue;
+            struct cook_queue *queue = &shm->stations[s];
+            slab_ref ref = slab_alloc(&shm->heap, sizeof(struct cook_order));
+            if (ref == 0) return -1;
+            struct cook_order *order = slab_ptr(&shm->heap, ref);
+            queue->orders[queue->back] = ref;
+            order->waiter_id = rec->waiter_id;
+            order->customer_id = order_ids[i];
+            order->customer_cnt = rec->count;
+            order->queued_at = shm->time;
+            queue->back++;
+        }
+    }
+
+    shm->empty_tables = shm->config.num_tables - seated;
+    return 0;
+}
+
+// Load a snapshot into a freshly created segment (keeping its new header),
+// rebuild the queues and set every semaphore to match them. Customers
+// still in the restaurant are brought back by the customer program.
+int snapshot_restore(struct shm_segment *shm, int semid, const char *path) {
+    struct snapshot_header hdr;
+    struct shm_header session = shm->header;
+
+    FILE *fp = fopen(path, "rb");
+    if (fp == NULL) {
+        perror(path);
+        return -1;
+    }
+    if (fread(&hdr, sizeof(hdr), 1, fp) != 1 || strcmp(hdr.magic, SNAPSHOT_MAGIC) != 0 ||
+        hdr.version != SNAPSHOT_VERSION || hdr.shm_version != SHM_VERSION ||
+        hdr.size != SHM_SIZE) {
+        fprintf(stderr, "%s: not a snapshot of this segment layout\n", path);
+        fclose(fp);
+        return -1;
+    }
+    if (fread(shm, SHM_SIZE, 1, fp) != 1) {
+        fprintf(stderr, "%s: truncated snapshot\n", path);
+        fclose(fp);
+        return -1;
+    }
+    fclose(fp);
+
+    shm->header = session;
+    if (rebuild_queues(shm) == -1) {
+        fprintf(stderr, "%s: in-flight orders do not fit in the slab heap\n", path);
+        return -1;
+    }
+    shm->restored = 1;
+    shm->engine = 0;   // set again by customer -a, whose counts start afresh
+    for (int id = 0; id < MAX_CUSTOMERS; id++) shm->customers[id].notify = 0;
+    memset(&shm->det, 0, sizeof(shm->det));  // a resumed session runs in real time
+
+    unsigned short values[NUM_SEMS] = {0};
+    values[MUTEX] = 1;
+    for (int s = 0; s < MAX_STATIONS; s++) {
+        values[STATION_BASE_SEM + s] = QUEUED(&shm->stations[s]);
+    }
+    for (int i = 0; i < NUM_WAITERS; i++) {
+        values[WAITER_U_SEM + i] = QUEUED(&shm->waiters[i]) + READY(&shm->waiters[i]);
+    }
+    union semun arg;
+    arg.array = values;
+    if (semctl(semid, 0, SETALL, arg) == -1) {
+        perror("semctl: SETALL");
+        return -1;
+    }
+    return 0;
+}
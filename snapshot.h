@@ -0,0 +1,24 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include "restaurant.h"
+
+#define SNAPSHOT_MAGIC "RSTSNAP"
+#define SNAPSHOT_VERSION 1
+#define SNAPSHOT_DEFAULT_PATH "restaurant.snap"
+#define SNAPSHOT_PAUSE_TARGET_US 1000
+
+// File header; the raw segment follows it
+struct snapshot_header {
+    char magic[8];
+    unsigned version;      // snapshot file format
+    unsigned shm_version;  // segment layout, must match SHM_VERSION
+    unsigned size;         // must match SHM_SIZE
+    unsigned generation;   // session the snapshot was taken from
+    int time;              // session clock when taken
+};
+
+int snapshot_save(struct shm_segment *shm, int semid, const char *path, long long *pause_ns);
+int snapshot_restore(struct shm_segment *shm, int semid, const char *path);
+
+#endif
@@ -0,0 +1,82 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/ipc.h>
+#include <sys/sem.h>
+
+#include "restaurant.h"
+
+static inline void cpu_relax(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#endif
+}
+
+// Take one unit from the semaphore without sleeping. Returns 1 on success.
+static int sem_try(int semid, int semnum) {
+    struct sembuf sb = {semnum, -1, IPC_NOWAIT};
+    if (semop(semid, &sb, 1) == 0) return 1;
+    if (errno != EAGAIN) {
+        perror("semop try");
+        exit(1);
+    }
+    return 0;
+}
+
+void spin_wait_init(struct spin_wait *w, int semid, int semnum, unsigned *seq,
+                    struct spin_stats *stats, int max_budget) {
+    w->semid = semid;
+    w->semnum = semnum;
+    w->seq = seq;
+    w->max_budget = max_budget;
+    w->stats = stats;
+    stats->budget = max_budget < SPIN_MIN_BUDGET ? max_budget : SPIN_MIN_BUDGET;
+}
+
+void spin_wait(struct spin_wait *w) {
+    struct spin_stats *stats = w->stats;
+
+    // Deterministic sessions never spin: the wait must yield the baton
+    if (w->max_budget > 0 && det == NULL) {
+        unsigned seen = __atomic_load_n(w->seq, __ATOMIC_ACQUIRE);
+        if (sem_try(w->semid, w->semnum)) {
+            stats->ready++;
+            return;
+        }
+        long long start = now_ns();
+
+        for (int i = 0; i < stats->budget; i++) {
+            cpu_relax();
+            unsigned cur = __atomic_load_n(w->seq, __ATOMIC_ACQUIRE);
+            if (cur == seen) continue;
+            seen = cur;
+            if (sem_try(w->semid, w->semnum)) {
+                stats->spin_hits++;
+                stats->budget *= 2;
+                if (stats->budget > w->max_budget) stats->budget = w->max_budget;
+                PROF(spin, PROF_SPIN, start);
+                return;
+            }
+        }
+
+        stats->budget /= 2;
+        if (stats->budget < SPIN_MIN_BUDGET) stats->budget = SPIN_MIN_BUDGET;
+        PROF(spin, PROF_SPIN, start);
+    }
+
+    sem_wait(w->semid, w->semnum);
+    stats->blocks++;
+}
+
+// Post the semaphore, then publish it through the sequence counter. The
+// order matters: a spinner that sees the new sequence must find the unit.
+void spin_signal(unsigned *seq, int semid, int semnum) {
+    sem_signal(semid, semnum);
+    __atomic_add_fetch(seq, 1, __ATOMIC_RELEASE);
+}
+
+void spin_report(const char *name, const struct spin_stats *stats) {
+    log_printf("%s: spin wait: ready=%lu spin_hits=%lu blocks=%lu budget=%d\n",
+           name, stats->ready, stats->spin_hits, stats->blocks, stats->budget);
+}
@@ -0,0 +1,35 @@
+#ifndef SPINWAIT_H
+#define SPINWAIT_H
+
+#define SPIN_MIN_BUDGET 16
+#define SPIN_DEFAULT_MAX 4096
+#define SPIN_LIMIT (1 << 20)       // largest -s accepted
+
+// Spin/block counters for one staff member, exported in shared memory so
+// they can be read while a session is running
+struct spin_stats {
+    unsigned long ready;       // work was already pending, no wait at all
+    unsigned long spin_hits;   // work arrived while spinning
+    unsigned long blocks;      // gave up spinning and slept in semop()
+    int budget;                // current spin budget in iterations
+};
+
+// Hybrid waiter on one semaphore. Signallers bump *seq after posting, so a
+// spinning waiter can watch a plain shared-memory word instead of polling
+// the kernel. The spin budget doubles on every hit and halves on every
+// block, within [SPIN_MIN_BUDGET, max_budget]; max_budget 0 always blocks.
+struct spin_wait {
+    int semid;
+    int semnum;
+    unsigned *seq;
+    int max_budget;
+    struct spin_stats *stats;
+};
+
+void spin_wait_init(struct spin_wait *w, int semid, int semnum, unsigned *seq,
+                    struct spin_stats *stats, int max_budget);
+void spin_wait(struct spin_wait *w);
+void spin_signal(unsigned *seq, int semid, int semnum);
+void spin_report(const char *name, const struct spin_stats *stats);
+
+#endif
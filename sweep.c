@@ -0,0 +1,434 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/ipc.h>
+#include <sys/shm.h>
+#include <sys/sem.h>
+#include <sys/wait.h>
+
+#include "restaurant.h"
+
+// Sweep the simulation over a grid of session parameters. Every
+// configuration is one cook/waiter/customer session under its own IPC
+// keys, several run at once, and the customer summary of each is
+// collected into one table.
+
+#define MAX_VALUES 32
+#define MAX_JOBS 256
+#define SWEEP_SCALE 2000        // 2ms per simulated minute
+#define SWEEP_TIMEOUT 120       // seconds before a session counts as hung
+#define START_TIMEOUT_USEC 5000000
+
+// The swept parameters, in table column order
+enum { P_COOKS, P_TABLES, P_PREP, P_ORDER, P_EAT, P_CLOSE, P_HIGH, P_MAXWAIT, P_PERTURB,
+       NUM_PARAMS };
+
+static const char param_opts[] = "ktpoezHWy";
+static const char *param_names[NUM_PARAMS] = {"cooks", "tables", "prep", "order", "eat", "close",
+                                              "high", "maxwt", "pturb"};
+
+struct grid {
+    int values[NUM_PARAMS][MAX_VALUES];
+    int count[NUM_PARAMS];
+};
+
+#define RUN_PENDING 0
+#define RUN_ACTIVE 1
+#define RUN_DONE 2
+#define RUN_FAILED 3
+#define RUN_TIMEOUT 4
+
+struct run {
+    int index;                  // seeds the run's perturbation
+    int param[NUM_PARAMS];
+    int status;
+    int slot;
+    key_t key;
+    pid_t pids[3];              // cook, waiter, customer
+    FILE *out;                  // customer output
+    long long deadline;
+    double seconds;
+    long long started;
+    int served, persons, no_table, late, too_busy;
+    int wait_p50, wait_p90, wait_p99, wait_max, end, deferred, violations;
+};
+
+static int scale = SWEEP_SCALE;
+static int timeout_s = SWEEP_TIMEOUT;
+static const char *customers_path = "customers.txt";
+static const char *seed = NULL;         // deterministic sessions with this seed
+static const char *menu_path = NULL;
+static const char *stations = NULL;
+static int async = 0;                   // customers in one event loop
+static int seed_base = 0;               // added to each run's perturbation seed
+
+// A menu sets each dish's minutes, so cook ignores -p and it is neither
+// passed nor shown
+static int param_used(int i) {
+    return i != P_PREP || menu_path == NULL;
+}
+
+// Parse "a,b,c" where each item is a value or an inclusive range "a-b"
+static int parse_list(const char *arg, int *values) {
+    int count = 0;
+    const char *p = arg;
+    while (*p != '\0') {
+        char *end;
+        long lo = strtol(p, &end, 10), hi = lo;
+        if (end == p) return -1;
+        if (*end == '-') {
+            p = end + 1;
+            hi = strtol(p, &end, 10);
+            if (end == p || hi < lo) return -1;
+        }
+        for (long v = lo; v <= hi; v++) {
+            if (count == MAX_VALUES) return -1;
+            values[count++] = v;
+        }
+        if (*end == ',') end++;
+        else if (*end != '\0') return -1;
+        p = end;
+    }
+    return count;
+}
+
+// Start one session process with the run's IPC key; its output goes to
+// fd out (or nowhere) and it leads its own process group so a hung
+// session can be killed together with the staff it forked
+static pid_t spawn(struct run *run, char *const argv[], int out) {
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("fork");
+        exit(1);
+    } else if (pid == 0) {
+        char key[16];
+        sprintf(key, "%d", (int)run->key);
+        setenv("RESTAURANT_IPC_KEY", key, 1);
+        setpgid(0, 0);
+        if (out == -1) out = open("/dev/null", O_WRONLY);
+        dup2(out, STDOUT_FILENO);
+        execv(argv[0], argv);
+        perror(argv[0]);
+        _exit(127);
+    }
+    setpgid(pid, pid);
+    return pid;
+}
+
+// Remove whatever a killed or failed session left under its keys
+static void remove_ipc(key_t key) {
+    int shmid = shmget(key, 0, 0);
+    if (shmid != -1) shmctl(shmid, IPC_RMID, NULL);
+    int semid = semget(key + 1, 0, 0);
+    if (semid != -1) semctl(semid, 0, IPC_RMID);
+}
+
+// Wait until cook has published the segment. Returns -1 if cook exits or
+// takes too long.
+static int wait_published(struct run *run) {
+    for (int waited = 0; waited < START_TIMEOUT_USEC; waited += 1000) {
+        if (waitpid(run->pids[0], NULL, WNOHANG) == run->pids[0]) {
+            run->pids[0] = 0;
+            return -1;
+        }
+        int shmid = shmget(run->key, 0, 0);
+        if (shmid != -1) {
+            struct shm_segment *shm = shmat(shmid, NULL, SHM_RDONLY);
+            if (shm != (void *)-1) {
+                int ready = __atomic_load_n(&shm->header.magic, __ATOMIC_ACQUIRE) == SHM_MAGIC;
+                shmdt(shm);
+                if (ready) return 0;
+            }
+        }
+        usleep(1000);
+    }
+    return -1;
+}
+
+static void kill_run(struct run *run) {
+    for (int i = 0; i < 3; i++) {
+        if (run->pids[i] > 0) {
+            kill(-run->pids[i], SIGKILL);
+            waitpid(run->pids[i], NULL, 0);
+            run->pids[i] = 0;
+        }
+    }
+    remove_ipc(run->key);
+}
+
+static void start_run(struct run *run, int slot) {
+    char args[NUM_PARAMS][16], scale_arg[16], seed_arg[32], perturb_arg[16];
+    char *cook_argv[2 * NUM_PARAMS + 8];
+    int n = 0;
+
+    cook_argv[n++] = "./cook";
+    cook_argv[n++] = "-b";
+    sprintf(scale_arg, "-u%d", scale);
+    cook_argv[n++] = scale_arg;
+    for (int i = 0; i < NUM_PARAMS; i++) {
+        if (!param_used(i)) continue;
+        sprintf(args[i], "-%c%d", param_opts[i], run->param[i]);
+        cook_argv[n++] = args[i];
+    }
+    sprintf(perturb_arg, "-Y%d", run->index);
+    cook_argv[n++] = perturb_arg;
+    if (seed != NULL) {
+        snprintf(seed_arg, sizeof(seed_arg), "-d%s", seed);
+        cook_argv[n++] = seed_arg;
+    }
+    if (menu_path != NULL) {
+        cook_argv[n++] = "-m";
+        cook_argv[n++] = (char *)menu_path;
+    }
+    if (stations != NULL) {
+        cook_argv[n++] = "-A";
+        cook_argv[n++] = (char *)stations;
+    }
+    cook_argv[n] = NULL;
+
+    char *waiter_argv[] = {"./waiter", "-b", NULL};
+    char *customer_argv[] = {"./customer", "-b", "-i", (char *)customers_path,
+                             async ? "-a" : NULL, NULL};
+
+    run->slot = slot;
+    run->key = 0x52000000 + ((getpid() & 0xfff) << 12) + 2 * slot;
+    run->out = tmpfile();
+    if (run->out == NULL) {
+        perror("tmpfile");
+        exit(1);
+    }
+    run->status = RUN_ACTIVE;
+    run->started = now_ns();
+    run->deadline = run->started + timeout_s * 1000000000LL;
+
+    remove_ipc(run->key);
+    run->pids[0] = spawn(run, cook_argv, -1);
+    if (wait_published(run) == -1) {
+        kill_run(run);
+        fclose(run->out);
+        run->status = RUN_FAILED;
+        return;
+    }
+    run->pids[1] = spawn(run, waiter_argv, -1);
+    run->pids[2] = spawn(run, customer_argv, fileno(run->out));
+}
+
+// All three processes of a run have exited: pick up the customer summary
+static void finish_run(struct run *run) {
+    char line[LOG_LINE_MAX];
+    run->seconds = (now_ns() - run->started) / 1e9;
+    rewind(run->out);
+    while (fgets(line, sizeof(line), run->out) != NULL) {
+        if (sscanf(line, "Customer: Summary: served=%d persons=%d no_table=%d late=%d too_busy=%d "
+                         "wait_p50=%d wait_p90=%d wait_p99=%d wait_max=%d end=%d deferred=%d "
+                         "violations=%d",
+                   &run->served, &run->persons, &run->no_table, &run->late, &run->too_busy,
+                   &run->wait_p50, &run->wait_p90, &run->wait_p99, &run->wait_max,
+                   &run->end, &run->deferred, &run->violations) == 12) {
+            run->status = RUN_DONE;
+        }
+    }
+    if (run->status != RUN_DONE) run->status = RUN_FAILED;
+    fclose(run->out);
+    remove_ipc(run->key);
+}
+
+static void print_table(const struct run *runs, int num_runs) {
+    for (int i = 0; i < NUM_PARAMS; i++) {
+        if (param_used(i)) printf("%6s ", param_names[i]);
+    }
+    printf("| %6s %7s %8s %4s %4s %4s %4s %4s %4s %5s %4s %8s %7s\n", "served", "persons",
+           "no_table", "late", "busy", "p50", "p90", "p99", "max", "defer", "inv", "pers/hr",
+           "secs");
+
+    for (int r = 0; r < num_runs; r++) {
+        const struct run *run = &runs[r];
+        for (int i = 0; i < NUM_PARAMS; i++) {
+            if (param_used(i)) printf("%6d ", run->param[i]);
+        }
+        if (run->status == RUN_DONE) {
+            printf("| %6d %7d %8d %4d %4d %4d %4d %4d %4d %5d %4d %8.1f %7.2f\n", run->served,
+                   run->persons, run->no_table, run->late, run->too_busy, run->wait_p50,
+                   run->wait_p90, run->wait_p99, run->wait_max, run->deferred, run->violations,
+                   run->persons * 60.0 / run->param[P_CLOSE], run->seconds);
+        } else {
+            printf("| %s\n", run->status == RUN_TIMEOUT ? "timeout" : "failed");
+        }
+    }
+}
+
+// One line for the whole sweep: sessions that broke an invariant, hung
+// or failed, and the parties served per second of real time. Returns the
+// number of sessions that were not clean.
+static int print_totals(const struct run *runs, int num_runs) {
+    int clean = 0, broken = 0, timeouts = 0, failed = 0;
+    long served = 0;
+    double seconds = 0;
+    for (int r = 0; r < num_runs; r++) {
+        const struct run *run = &runs[r];
+        if (run->status == RUN_TIMEOUT) {
+            timeouts++;
+        } else if (run->status != RUN_DONE) {
+            failed++;
+        } else {
+            if (run->violations > 0) broken++;
+            else clean++;
+            served += run->served;
+            seconds += run->seconds;
+        }
+    }
+    printf("Sweep: %d sessions: %d clean, %d with violations, %d timed out, %d failed; "
+           "%.1f parties served per session second\n", num_runs, clean, broken, timeouts,
+           failed, seconds > 0 ? served / seconds : 0.0);
+    return num_runs - clean;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr, "Usage: %s [-j jobs] [-u usec_per_minute] [-w timeout_s] [-i customers_file]\n"
+                    "       [-d seed | -a] [-m menu_file] [-A station,...] [-Y seed_base]\n"
+                    "       [-k cooks] [-t tables] [-p cook_minutes] [-o order_minutes]\n"
+                    "       [-e eat_minutes] [-z closing_time] [-H high_water] [-W max_wait]\n"
+                    "       [-y perturb_permille]\n"
+                    "Each of -k -t -p -o -e -z -H -W -y takes a list of values and ranges, e.g. -k 1-3 -t 6,10\n",
+            prog);
+    exit(1);
+}
+
+int main(int argc, char *argv[]) {
+    struct grid grid;
+    int jobs = sysconf(_SC_NPROCESSORS_ONLN);
+    int opt;
+
+    struct session_config defaults;
+    config_defaults(&defaults);
+    int default_values[NUM_PARAMS] = {defaults.num_cooks, defaults.num_tables,
+                                      defaults.cook_minutes, defaults.order_minutes,
+                                      defaults.eat_minutes, defaults.closing_time,
+                                      defaults.high_water, defaults.max_wait,
+                                      defaults.perturb};
+    for (int i = 0; i < NUM_PARAMS; i++) {
+        grid.values[i][0] = default_values[i];
+        grid.count[i] = 1;
+    }
+
+    while ((opt = getopt(argc, argv, "j:u:w:i:d:m:A:aY:k:t:p:o:e:z:H:W:y:")) != -1) {
+        const char *param = strchr(param_opts, opt);
+        if (opt == 'j') {
+            if (parse_int_option(opt, optarg, 1, MAX_JOBS, &jobs) == -1) usage(argv[0]);
+        } else if (opt == 'u') {
+            if (parse_int_option(opt, optarg, 1, 10000000, &scale) == -1) usage(argv[0]);
+        } else if (opt == 'w') {
+            if (parse_int_option(opt, optarg, 1, 86400, &timeout_s) == -1) usage(argv[0]);
+        }
+        else if (opt == 'i') customers_path = optarg;
+        else if (opt == 'd') seed = optarg;
+        else if (opt == 'm') menu_path = optarg;
+        else if (opt == 'A') stations = optarg;
+        else if (opt == 'a') async = 1;
+        else if (opt == 'Y') {
+            if (parse_int_option(opt, optarg, 0, 0x7fffffff, &seed_base) == -1) usage(argv[0]);
+        }
+        else if (opt != '?' && param != NULL) {
+            int i = param - param_opts;
+            grid.count[i] = parse_list(optarg, grid.values[i]);
+            if (grid.count[i] <= 0) {
+                fprintf(stderr, "Invalid list for -%c: %s\n", opt, optarg);
+                usage(argv[0]);
+            }
+        } else {
+            usage(argv[0]);
+        }
+    }
+    if (jobs < 1) jobs = 1;
+    if (jobs > MAX_JOBS) jobs = MAX_JOBS;
+    if (async && seed != NULL) usage(argv[0]);
+    if (menu_path != NULL && grid.count[P_PREP] > 1) {
+        fprintf(stderr, "-p has no effect with -m: dish minutes come from the menu\n");
+        usage(argv[0]);
+    }
+
+    // Expand the grid, first parameter varying slowest
+    int num_runs = 1;
+    for (int i = 0; i < NUM_PARAMS; i++) num_runs *= grid.count[i];
+    if (seed_base > 0x7fffffff - num_runs) {
+        fprintf(stderr, "Invalid value for -Y: %d leaves no seed for %d runs\n", seed_base,
+                num_runs);
+        usage(argv[0]);
+    }
+    struct run *runs = calloc(num_runs, sizeof(struct run));
+    if (runs == NULL) {
+        perror("calloc");
+        exit(1);
+    }
+    for (int r = 0; r < num_runs; r++) {
+        int index = r;
+        runs[r].index = seed_base + r + 1;
+        for (int i = NUM_PARAMS - 1; i >= 0; i--) {
+            runs[r].param[i] = grid.values[i][index % grid.count[i]];
+            index /= grid.count[i];
+        }
+    }
+
+    fprintf(stderr, "Sweep: %d configurations, %d at a time, %d us per minute\n",
+            num_runs, jobs, scale);
+
+    int slot_busy[MAX_JOBS] = {0};
+    int next = 0, active = 0, finished = 0;
+    while (finished < num_runs) {
+        // Fill the free slots
+        for (int slot = 0; slot < jobs && next < num_runs; slot++) {
+            if (slot_busy[slot]) continue;
+            start_run(&runs[next], slot);
+            if (runs[next].status == RUN_ACTIVE) {
+                slot_busy[slot] = 1;
+                active++;
+            } else {
+                finished++;
+            }
+            next++;
+        }
+
+        // Reap whatever exited and kill sessions past their deadline
+        int status;
+        pid_t pid;
+        while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+            for (int r = 0; r < num_runs; r++) {
+                for (int i = 0; i < 3; i++) {
+                    if (runs[r].status == RUN_ACTIVE && runs[r].pids[i] == pid) {
+                        runs[r].pids[i] = 0;
+                    }
+                }
+            }
+        }
+        long long now = now_ns();
+        for (int r = 0; r < num_runs; r++) {
+            struct run *run = &runs[r];
+            if (run->status != RUN_ACTIVE) continue;
+            if (run->pids[0] == 0 && run->pids[1] == 0 && run->pids[2] == 0) {
+                finish_run(run);
+            } else if (now > run->deadline) {
+                kill_run(run);
+                fclose(run->out);
+                run->status = RUN_TIMEOUT;
+            } else {
+                continue;
+            }
+            slot_busy[run->slot] = 0;
+            active--;
+            finished++;
+            fprintf(stderr, "Sweep: %d/%d done\r", finished, num_runs);
+        }
+        if (active > 0) usleep(10000);
+    }
+    fprintf(stderr, "\n");
+
+    print_table(runs, num_runs);
+    int unclean = print_totals(runs, num_runs);
+    free(runs);
+    return unclean > 0 ? 1 : 0;
+}